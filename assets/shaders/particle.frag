@@ -1,4 +1,3 @@
-in flat float ttl;
 in vec4 ttlColor;
 
 out vec4 fragColor;
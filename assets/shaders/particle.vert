@@ -1,33 +1,67 @@
 layout(location = 0) in vec2 vertexPosition;
+#ifdef COMPACT_INSTANCES
+//Half floats, the position is relative to the spawner anchor
+layout(location = 1) in vec4 particleOffsetSize;
+layout(location = 2) in vec2 velocity;
+layout(location = 3) in vec2 rotationAliveFor;
+layout(location = 4) in float aliveUntil;
+#else
 layout(location = 1) in vec4 particlePosSize;
-layout(location = 2) in vec4 velocityAliveUntilAliveFor;
+layout(location = 2) in vec2 velocity;
 layout(location = 3) in float rotation;
+layout(location = 4) in float aliveUntil;
+layout(location = 5) in float aliveFor;
+#endif
 
 uniform mat4 viewProjection;
 uniform float simulationTime;
 
-uniform sampler1D colorGradient;
+//Command of the draw call, gl_DrawIDARB counts the commands of a multi draw from it
+uniform int firstDraw;
 
-out flat float ttl;
 out vec4 ttlColor;
 
 void main()
 {
-  //Calculate ttl stuff
-  ttl = (velocityAliveUntilAliveFor.z - simulationTime);
-  float ttlPercent = ttl * (1.0 / velocityAliveUntilAliveFor.w);
+#ifdef DRAW_PARAMETERS
+  vec4 parameters = texelFetch(drawParameters, firstDraw + gl_DrawIDARB);
+#else
+  vec4 parameters = texelFetch(drawParameters, firstDraw);
+#endif
+
+#ifdef COMPACT_INSTANCES
+  vec4 particlePosSize = vec4(parameters.xyz + particleOffsetSize.xyz, particleOffsetSize.w);
+  float rotation = rotationAliveFor.x;
+  float aliveFor = rotationAliveFor.y;
+#endif
 
-  ttlColor = texture(colorGradient, 1.0 - ttlPercent);
+  //Calculate ttl stuff
+  float ttl = (aliveUntil - simulationTime);
+  //Particles expiring out of spawn order stay resident until older ones died, move them outside the clip volume
+  if (ttl <= 0.0) {
+    ttlColor = vec4(0.0);
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    return;
+  }
+  float ttlPercent = ttl * (1.0 / aliveFor);
 
-  float fullLifeDuration = velocityAliveUntilAliveFor.w;
+  float fullLifeDuration = aliveFor;
   float lifePassed = fullLifeDuration - ttl;
 
   //Calculate position
-  vec2 movement = lifePassed * velocityAliveUntilAliveFor.xy;
+  vec2 movement = lifePassed * velocity;
 
   float size = particlePosSize.w;
   size = size * 0.5 * ttlPercent + size * 0.5;
   vec4 particleCenter = viewProjection * vec4(particlePosSize.xyz + vec3(movement, 0.0), 1.0);
+  //The corner below adds the translation of viewProjection a second time
+  if (subPixel(size, particleCenter.w + viewProjection[3].w)) {
+    ttlColor = vec4(0.0);
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    return;
+  }
+
+  ttlColor = gradientColor(parameters.w, 1.0 - ttlPercent);
   vec2 vPos = vertexPosition * vec2(size, size);
 
   float cosRot = cos(rotation);
@@ -0,0 +1,37 @@
+//Declarations shared by the GpuParticleSimulation compute programs, prepended to each of them
+
+//Particle pool, one array per InstanceFormat::Float stream. Group g owns the slots [base, base + mask + 1).
+layout(std430, binding = 0) buffer PositionSize { vec4 positionSize[]; };
+layout(std430, binding = 1) buffer Velocity { vec2 velocity[]; };
+layout(std430, binding = 2) buffer Rotation { float rotation[]; };
+layout(std430, binding = 3) buffer AliveUntil { float aliveUntil[]; };
+layout(std430, binding = 4) buffer AliveFor { float aliveFor[]; };
+
+//Written by the CPU every update, sequence numbers are 64 bit as (low, high)
+struct Group
+{
+  uint base;
+  uint mask;
+  //Philox key word 0
+  uint spawner;
+  uint padding;
+  //Head before the bursts of this update, the retire pass stops there
+  uvec2 retireEnd;
+  uvec2 head;
+  //TruncatedNormal of every SpawnerSampler::Property
+  vec4 mid[2];
+  vec4 halfRange[2];
+};
+
+layout(std430, binding = 5) readonly buffer Groups { Group groups[]; };
+
+//Sequence number of the oldest resident particle of every group, only ever written on the GPU
+layout(std430, binding = 6) buffer Tails { uvec2 tails[]; };
+
+//Tail + offset with the carry into the high word
+uvec2 advance(uvec2 sequence, uint offset)
+{
+  uint carry;
+  uint low = uaddCarry(sequence.x, offset, carry);
+  return uvec2(low, sequence.y + carry);
+}
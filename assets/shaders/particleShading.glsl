@@ -0,0 +1,58 @@
+//Declarations shared by particle.vert, particleSprite.vert and particleSprites.comp, concatenated before them
+#ifdef DRAW_PARAMETERS
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+#ifdef ANALYTIC_GRADIENT
+//Evenly spaced stops, the fade in ramps up alpha at the start of the life
+struct Gradient
+{
+  vec4 stops[GRADIENT_STOPS];
+  float fadeIn;
+};
+
+//Window of the gradients bound for the draw call
+layout(std140, binding = 0) uniform Gradients { Gradient gradients[GRADIENT_CAPACITY]; };
+
+vec4 gradientColor(float index, float t)
+{
+  Gradient gradient = gradients[int(index)];
+  float x = clamp(t, 0.0, 1.0) * float(GRADIENT_STOPS - 1);
+  int stop = min(int(x), GRADIENT_STOPS - 2);
+  vec4 color = mix(gradient.stops[stop], gradient.stops[stop + 1], x - float(stop));
+  color.a *= gradient.fadeIn > 0.0 ? min(t / gradient.fadeIn, 1.0) : 1.0;
+  return clamp(color, 0.0, 1.0);
+}
+#else
+//One layer per spawner
+uniform sampler1DArray colorGradient;
+
+vec4 gradientColor(float layer, float t)
+{
+  return texture(colorGradient, vec2(t, layer));
+}
+#endif
+
+//Per draw command: xyz anchor of compact positions, w gradient layer or index in the gradient window
+uniform samplerBuffer drawParameters;
+
+//Pixels covered by one world unit at w = 1 along the screen axes and the smallest particle size drawn in pixels
+uniform vec2 pixelsPerUnit;
+uniform float minPixelSize;
+
+//True if a quad of the size in front of the camera stays below minPixelSize at clip space w
+bool subPixel(float size, float w)
+{
+  vec2 pixels = size * pixelsPerUnit / w;
+  return w > 0.0 && max(pixels.x, pixels.y) < minPixelSize;
+}
+
+//Clip space quad of one particle written by particleSprites.comp, corner (x, y) of the quad is
+//center + x * axisX + y * axisY for x, y in {-0.5, 0.5}
+struct Sprite
+{
+  vec4 center;
+  vec4 axisX;
+  vec4 axisY;
+  vec4 color;
+};
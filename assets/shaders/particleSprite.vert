@@ -0,0 +1,18 @@
+//Vertex pulling of the sprites written by particleSprites.comp, vertex 4 * i + c is corner c of sprite i. The index
+//buffer turns the four corners into two triangles, so every corner runs once.
+//The sprite buffer is read through a buffer texture, four RGBA32F texels per sprite: llvmpipe gathers shader storage
+//loads in the vertex stage lane by lane, texel fetches take its vectorized path.
+uniform samplerBuffer sprites;
+
+out vec4 ttlColor;
+
+void main()
+{
+  int texel = (gl_VertexID / 4) * 4;
+  Sprite sprite = Sprite(texelFetch(sprites, texel), texelFetch(sprites, texel + 1), texelFetch(sprites, texel + 2),
+                         texelFetch(sprites, texel + 3));
+  int corner = gl_VertexID % 4;
+  vec2 position = vec2(float(corner & 1) - 0.5, float(corner >> 1) - 0.5);
+  gl_Position = sprite.center + position.x * sprite.axisX + position.y * sprite.axisY;
+  ttlColor = sprite.color;
+}
@@ -0,0 +1,788 @@
+#include "aw/engine/particleSystem/spawner.hpp"
+#include "aw/engine/particleSystem/system.hpp"
+#include "aw/util/math/transform.hpp"
+#include "entt/entity/helper.hpp"
+#include "entt/entity/registry.hpp"
+#include "hiddenContext.hpp"
+#include "jobPool.hpp"
+#include "particleSystem/expiryWheel.hpp"
+#include "particleSystem/instanceFormat.hpp"
+#include "particleSystem/kernels.hpp"
+#include "particleSystem/philox.hpp"
+#include "particleSystem/pool.hpp"
+#include "particleSystem/renderer.hpp"
+#include "particleSystem/simulation.hpp"
+#include "particleSystem/streams.hpp"
+#include "particleSystem/truncatedNormal.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+// Every heap allocation of the process goes through these, so allocations per frame can be reported
+namespace {
+std::atomic<std::size_t> gAllocations{0};
+std::atomic<std::size_t> gAllocatedBytes{0};
+} // namespace
+
+void* operator new(std::size_t size)
+{
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  if (auto ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+auto currentRssBytes() -> std::size_t
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters{};
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+  mach_task_basic_info info{};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count);
+  return static_cast<std::size_t>(info.resident_size);
+#else
+  // Second field of statm is the resident page count
+  std::size_t pages = 0;
+  if (auto* file = std::fopen("/proc/self/statm", "r")) {
+    if (std::fscanf(file, "%*s %zu", &pages) != 1) {
+      pages = 0;
+    }
+    std::fclose(file);
+  }
+  return pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// The peak RSS of the process never goes down, so every scenario reports the resident bytes it added to the baseline
+// taken before it started, measured while its data is still alive
+auto rssGrowth(std::size_t baseline) -> std::size_t
+{
+  const auto current = currentRssBytes();
+  return current > baseline ? current - baseline : 0;
+}
+
+struct SimulationScenario
+{
+  const char* name;
+  int spawners;
+  float amount;
+  float interval;
+  float ttl;
+};
+
+// Live particles in steady state are roughly spawners * amount * ttl / interval
+const std::vector<SimulationScenario> simulationScenarios = {
+    {"1_spawner_1k_live", 1, 100.f, 0.1f, 1.f},
+    {"1_spawner_1M_live", 1, 10000.f, 0.1f, 10.f},
+    {"1_spawner_10M_live", 1, 100000.f, 0.1f, 10.f},
+    {"10k_spawners_1k_live", 10000, 1.f, 1.f, 0.1f},
+    {"10k_spawners_1M_live", 10000, 10.f, 0.1f, 1.f},
+    {"short_ttl", 100, 100.f, 1.f / 60.f, 0.05f},
+    {"long_ttl", 100, 10.f, 0.1f, 30.f},
+    {"burst_amount", 10, 50000.f, 1.f, 0.5f},
+};
+
+// Drawn into the 1x1 default framebuffer of a hidden window, so the GPU time is dominated by the vertex work
+const std::vector<SimulationScenario> renderScenarios = {
+    {"render_1_spawner_100k_live", 1, 10000.f, 0.1f, 1.f},
+    {"render_1k_spawners_1M_live", 1000, 100.f, 0.1f, 1.f},
+};
+
+struct SamplingScenario
+{
+  const char* name;
+  float min;
+  float max;
+};
+
+const std::vector<SamplingScenario> samplingScenarios = {
+    {"sample_unit_range", 0.f, 1.f},
+    {"sample_wide_range", -100.f, 100.f},
+    {"sample_narrow_range", 0.999f, 1.f},
+    {"sample_degenerate_range", 1.f, 1.f},
+};
+
+struct Options
+{
+  std::string outputPath{"awParticleBench.json"};
+  std::string filter;
+  int frames{120};
+  float timestep{1.f / 60.f};
+  int samples{10'000'000};
+  std::size_t threads{JobPool::defaultWorkerCount()};
+  // Shader directory of the renderer, the render scenarios only run if it is set
+  std::string renderShaders;
+  // "--self-check": checks the simulation's pool and expiry wheel instead of running scenarios
+  bool selfCheck{false};
+};
+
+struct Result
+{
+  std::string name;
+  std::string kind;
+  std::string storage;
+  std::size_t frames{0};
+  double nsPerParticle{0.0};
+  double msPerFrame{0.0};
+  double averageLiveParticles{0.0};
+  double allocationsPerFrame{0.0};
+  double allocatedBytesPerFrame{0.0};
+  double integrateNsPerParticle{0.0};
+  std::size_t rssGrowthBytes{0};
+  // Precision cost of InstanceFormat::Compact, stream storage only
+  bool hasCompactError{false};
+  CompactError compactError;
+};
+
+auto makeSpawner(const SimulationScenario& scenario) -> aw::ParticleSpawner
+{
+  aw::ParticleSpawner spawner;
+  spawner.amount = aw::ClampedNormalDist(scenario.amount, scenario.amount);
+  spawner.interval = aw::ClampedNormalDist(scenario.interval, scenario.interval);
+  spawner.ttl = aw::ClampedNormalDist(scenario.ttl, scenario.ttl);
+  return spawner;
+}
+
+// ParticlePool big enough for the scenario's rings. A growing ring holds its old span while the new one twice its size
+// is handed out, so every ring gets twice its steady state capacity.
+auto poolCapacity(const SimulationScenario& scenario) -> std::size_t
+{
+  const auto live = static_cast<std::size_t>(scenario.amount * (scenario.ttl / scenario.interval + 1.f));
+  std::size_t ring = ParticlePool::minSpan;
+  while (ring < live) {
+    ring *= 2;
+  }
+  return static_cast<std::size_t>(scenario.spawners) * 2 * ring;
+}
+
+auto runSimulation(const SimulationScenario& scenario, ParticleStorage storage, const Options& options)
+    -> Result
+{
+  const auto rssBaseline = currentRssBytes();
+  entt::registry world;
+  JobPool jobs{options.threads};
+  aw::ParticleSystem engineParticleSystem{world};
+  ParticleSimulation particleSystem{world, jobs, 0, poolCapacity(scenario)};
+
+  const auto spawner = makeSpawner(scenario);
+  for (int i = 0; i < scenario.spawners; i++) {
+    auto entity = world.create();
+    world.assign<aw::Transform>(entity);
+    world.assign<aw::ParticleSpawner>(entity, spawner);
+  }
+
+  auto update = [&] {
+    if (storage == ParticleStorage::Aos) {
+      engineParticleSystem.update(aw::Seconds{options.timestep}, entt::as_view(world));
+    } else {
+      particleSystem.update(aw::Seconds{options.timestep});
+    }
+  };
+  auto liveParticles = [&] {
+    if (storage == ParticleStorage::Aos) {
+      const auto& p = engineParticleSystem.particles();
+      return std::accumulate(p.begin(), p.end(), std::size_t{0},
+                             [](auto sum, auto& element) { return sum + element.particles.size(); });
+    }
+    return particleSystem.stats().live;
+  };
+
+  // Warm up until the particle count reached its steady state
+  const auto warmupFrames = static_cast<int>((scenario.ttl + scenario.interval) / options.timestep) + 1;
+  for (int i = 0; i < warmupFrames; i++) {
+    update();
+  }
+
+  double updateNs = 0.0;
+  std::size_t particleUpdates = 0;
+  const auto allocationsBefore = gAllocations.load();
+  const auto bytesBefore = gAllocatedBytes.load();
+  for (int i = 0; i < options.frames; i++) {
+    const auto begin = Clock::now();
+    update();
+    updateNs += std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+    particleUpdates += liveParticles();
+  }
+
+  Result result;
+  result.name = scenario.name;
+  result.kind = "simulation";
+  result.storage = particleStorageName(storage);
+  result.frames = static_cast<std::size_t>(options.frames);
+  result.nsPerParticle = updateNs / static_cast<double>(std::max<std::size_t>(particleUpdates, 1));
+  result.msPerFrame = updateNs / 1e6 / options.frames;
+  result.averageLiveParticles = static_cast<double>(particleUpdates) / options.frames;
+  result.allocationsPerFrame = static_cast<double>(gAllocations.load() - allocationsBefore) / options.frames;
+  result.allocatedBytesPerFrame = static_cast<double>(gAllocatedBytes.load() - bytesBefore) / options.frames;
+
+  // CPU side evaluation of the motion model, only available for the stream storage
+  if (storage == ParticleStorage::Soa) {
+    double integrateNs = 0.0;
+    std::size_t integrated = 0;
+    std::vector<aw::Vec4> positions;
+    for (const auto& group : particleSystem.particles()) {
+      positions.resize(group.streams.size());
+      const auto begin = Clock::now();
+      kernels::integrate(group.streams, particleSystem.simulationTime(), positions.data());
+      integrateNs += std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+      integrated += group.streams.size();
+    }
+    result.integrateNsPerParticle = integrateNs / static_cast<double>(std::max<std::size_t>(integrated, 1));
+    result.hasCompactError = true;
+    result.compactError = measureCompactError(particleSystem.particles(), particleSystem.simulationTime());
+  }
+  result.rssGrowthBytes = rssGrowth(rssBaseline);
+  return result;
+}
+
+// GPU time of ParticleStreamRenderer::render measured with GL_TIME_ELAPSED queries, the simulation is not timed.
+// Empty if the context does not support the expansion.
+auto runRender(const SimulationScenario& scenario, QuadExpansion expansion, const Options& options)
+    -> std::optional<Result>
+{
+  const auto rssBaseline = currentRssBytes();
+  entt::registry world;
+  JobPool jobs{options.threads};
+  ParticleSimulation particleSystem{world, jobs, 0, poolCapacity(scenario)};
+  ParticleStreamRenderer renderer{options.renderShaders};
+  if (expansion == QuadExpansion::Pulled && !renderer.pulledQuadsSupported()) {
+    return std::nullopt;
+  }
+  renderer.setQuadExpansion(expansion);
+  // Every particle covers less than a pixel of the 1x1 viewport, only the frustum is culled
+  renderer.setMinPixelSize(0.f);
+
+  const auto spawner = makeSpawner(scenario);
+  for (int i = 0; i < scenario.spawners; i++) {
+    auto entity = world.create();
+    world.assign<aw::Transform>(entity);
+    world.assign<aw::ParticleSpawner>(entity, spawner);
+  }
+
+  const auto warmupFrames = static_cast<int>((scenario.ttl + scenario.interval) / options.timestep) + 1;
+  for (int i = 0; i < warmupFrames; i++) {
+    particleSystem.update(aw::Seconds{options.timestep});
+  }
+
+  aw::Mat4 viewProjection{1.f};
+  viewProjection[0][0] = 0.1f;
+  viewProjection[1][1] = 0.1f;
+  auto render = [&] {
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderer.render(viewProjection, particleSystem.simulationTime(), particleSystem.particles());
+  };
+  // Uploads every resident particle and allocates the buffers
+  render();
+
+  GLuint query = 0;
+  glGenQueries(1, &query);
+  double renderNs = 0.0;
+  std::size_t particleDraws = 0;
+  for (int i = 0; i < options.frames; i++) {
+    particleSystem.update(aw::Seconds{options.timestep});
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    render();
+    glEndQuery(GL_TIME_ELAPSED);
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    renderNs += static_cast<double>(elapsed);
+    const auto& p = particleSystem.particles();
+    particleDraws += std::accumulate(p.begin(), p.end(), std::size_t{0},
+                                     [](auto sum, auto& element) { return sum + element.streams.size(); });
+  }
+  glDeleteQueries(1, &query);
+
+  Result result;
+  result.name = std::string{scenario.name} + (expansion == QuadExpansion::Pulled ? "_pulled" : "_instanced");
+  result.kind = "render";
+  result.storage = particleStorageName(ParticleStorage::Soa);
+  result.frames = static_cast<std::size_t>(options.frames);
+  result.nsPerParticle = renderNs / static_cast<double>(std::max<std::size_t>(particleDraws, 1));
+  result.msPerFrame = renderNs / 1e6 / options.frames;
+  result.averageLiveParticles = static_cast<double>(particleDraws) / options.frames;
+  result.rssGrowthBytes = rssGrowth(rssBaseline);
+  return result;
+}
+
+// Samples from one distribution copy with a sequential generator, the way the engine's aw::ParticleSystem does
+auto runSampling(const SamplingScenario& scenario, const Options& options) -> Result
+{
+  const auto rssBaseline = currentRssBytes();
+  std::mt19937 rng{42};
+  aw::ClampedNormalDist dist{scenario.min, scenario.max};
+
+  const auto allocationsBefore = gAllocations.load();
+  volatile float sink = 0.f;
+  const auto begin = Clock::now();
+  for (int i = 0; i < options.samples; i++) {
+    sink = sink + dist(rng);
+  }
+  const auto ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+
+  Result result;
+  result.name = std::string{scenario.name} + "_mt19937";
+  result.kind = "sampling";
+  result.storage = "none";
+  result.frames = 1;
+  result.nsPerParticle = ns / options.samples;
+  result.allocationsPerFrame = static_cast<double>(gAllocations.load() - allocationsBefore);
+  result.rssGrowthBytes = rssGrowth(rssBaseline);
+  return result;
+}
+
+// aw::ClampedNormalDist fed by philox words generated in batches of 64 indices, every index draws 8 samples from a
+// fresh distribution copy
+auto runPhiloxSampling(const SamplingScenario& scenario, const Options& options) -> Result
+{
+  const auto rssBaseline = currentRssBytes();
+  constexpr std::size_t batchSize = 64;
+  constexpr std::uint32_t blocks = 6;
+  constexpr int samplesPerIndex = 8;
+  const philox::Key key{1, 42};
+  const aw::ClampedNormalDist dist{scenario.min, scenario.max};
+  std::vector<std::uint32_t> words(batchSize * blocks * 4);
+
+  const auto indices = static_cast<std::size_t>(options.samples / samplesPerIndex);
+  const auto allocationsBefore = gAllocations.load();
+  volatile float sink = 0.f;
+  const auto begin = Clock::now();
+  for (std::size_t first = 0; first < indices; first += batchSize) {
+    const auto count = std::min(batchSize, indices - first);
+    philox::fill(key, philox::Stream::Particle, first, count, blocks, words.data());
+    for (std::size_t j = 0; j < count; j++) {
+      philox::Generator rng{key, philox::Stream::Particle, first + j, words.data() + j, count, blocks};
+      auto sample = dist;
+      for (int s = 0; s < samplesPerIndex; s++) {
+        sink = sink + sample(rng);
+      }
+    }
+  }
+  const auto ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+
+  Result result;
+  result.name = std::string{scenario.name} + "_philox";
+  result.kind = "sampling";
+  result.storage = "none";
+  result.frames = 1;
+  result.nsPerParticle = ns / static_cast<double>(std::max<std::size_t>(indices * samplesPerIndex, 1));
+  result.allocationsPerFrame = static_cast<double>(gAllocations.load() - allocationsBefore);
+  result.rssGrowthBytes = rssGrowth(rssBaseline);
+  return result;
+}
+
+// Samples the way ParticleSimulation::fill does, one philox word per TruncatedNormal sample
+auto runTableSampling(const SamplingScenario& scenario, const Options& options) -> Result
+{
+  const auto rssBaseline = currentRssBytes();
+  constexpr std::size_t batchSize = 64;
+  constexpr std::uint32_t blocks = 2;
+  const TruncatedNormal dist{scenario.min, scenario.max};
+  std::vector<std::uint32_t> words(batchSize * blocks * 4);
+
+  const auto wordsPerBatch = batchSize * blocks * 4;
+  const auto batches = (static_cast<std::size_t>(options.samples) + wordsPerBatch - 1) / wordsPerBatch;
+  const auto allocationsBefore = gAllocations.load();
+  volatile float sink = 0.f;
+  const auto begin = Clock::now();
+  for (std::size_t batch = 0; batch < batches; batch++) {
+    philox::fill({1, 42}, philox::Stream::Particle, batch * batchSize, batchSize, blocks, words.data());
+    auto sum = 0.f;
+    for (auto word : words) {
+      sum += dist(word);
+    }
+    sink = sink + sum;
+  }
+  const auto ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+
+  Result result;
+  result.name = std::string{scenario.name} + "_table";
+  result.kind = "sampling";
+  result.storage = "none";
+  result.frames = 1;
+  result.nsPerParticle = ns / static_cast<double>(std::max<std::size_t>(batches * wordsPerBatch, 1));
+  result.allocationsPerFrame = static_cast<double>(gAllocations.load() - allocationsBefore);
+  result.rssGrowthBytes = rssGrowth(rssBaseline);
+  return result;
+}
+
+// Raw 32 bit words per second of both generators, ns_per_particle is per word
+auto runRandomWords(const Options& options) -> std::vector<Result>
+{
+  const auto rssBaseline = currentRssBytes();
+  const auto wordCount = static_cast<std::size_t>(options.samples);
+  std::vector<std::uint32_t> words(wordCount);
+  auto makeResult = [&](const char* name, double ns) {
+    Result result;
+    result.name = name;
+    result.kind = "random_words";
+    result.storage = "none";
+    result.frames = 1;
+    result.nsPerParticle = ns / static_cast<double>(wordCount);
+    result.rssGrowthBytes = rssGrowth(rssBaseline);
+    return result;
+  };
+
+  std::vector<Result> results;
+  std::mt19937 rng{42};
+  auto begin = Clock::now();
+  for (auto& word : words) {
+    word = rng();
+  }
+  const auto mtNs = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+  results.push_back(makeResult("random_words_mt19937", mtNs));
+
+  begin = Clock::now();
+  philox::fill({1, 42}, philox::Stream::Particle, 0, wordCount / 4, 1, words.data());
+  const auto philoxNs = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+  results.push_back(makeResult("random_words_philox", philoxNs));
+  return results;
+}
+
+// Prints what failed, the checks go on after a failure
+auto selfCheck(const char* name, bool passed) -> bool
+{
+  if (!passed) {
+    std::fprintf(stderr, "self-check failed: %s\n", name);
+  }
+  return passed;
+}
+
+auto checkPool() -> bool
+{
+  using Pool = ParticlePool;
+  auto passed = true;
+
+  // Exhausting the arena in the smallest spans and releasing them out of order merges them back into one span, all of
+  // it without touching the heap
+  {
+    Pool pool{std::size_t{1} << 16};
+    std::vector<unsigned char*> spans;
+    spans.reserve(pool.capacity() / Pool::minSpan);
+    const auto allocations = gAllocations.load();
+    while (auto* span = pool.allocate(Pool::minSpan)) {
+      spans.push_back(span);
+    }
+    passed &= selfCheck("pool exhausted in minSpan spans", spans.size() == pool.capacity() / Pool::minSpan);
+    passed &= selfCheck("pool used when exhausted", pool.used() == pool.capacity());
+    passed &= selfCheck("pool failed allocation counted", pool.counters().failed == 1);
+    std::mt19937 rng{7};
+    std::shuffle(spans.begin(), spans.end(), rng);
+    for (auto* span : spans) {
+      pool.release(span, Pool::minSpan);
+    }
+    passed &= selfCheck("pool allocates without the heap", gAllocations.load() == allocations);
+    passed &= selfCheck("pool empty after releases", pool.used() == 0);
+    passed &= selfCheck("pool buddies merged into one span", pool.allocate(pool.capacity()) != nullptr);
+  }
+
+  // Random allocations and releases of any size hand out aligned spans that never overlap
+  {
+    Pool pool{std::size_t{1} << 18};
+    // The first span of an empty pool starts the arena
+    auto* arena = pool.allocate(Pool::minSpan);
+    pool.release(arena, Pool::minSpan);
+
+    struct Span
+    {
+      unsigned char* span;
+      std::size_t particles;
+      std::size_t size;
+    };
+    std::vector<Span> spans;
+    std::mt19937 rng{11};
+    auto overlapFree = true;
+    auto aligned = true;
+    for (int i = 0; i < 20000; i++) {
+      if (!spans.empty() && rng() % 2 == 0) {
+        const auto victim = rng() % spans.size();
+        pool.release(spans[victim].span, spans[victim].particles);
+        spans[victim] = spans.back();
+        spans.pop_back();
+        continue;
+      }
+      const auto particles = std::size_t{1} + rng() % 20000;
+      if (auto* span = pool.allocate(particles)) {
+        auto size = Pool::minSpan;
+        while (size < particles) {
+          size *= 2;
+        }
+        aligned &= static_cast<std::size_t>(span - arena) / Pool::particleBytes % size == 0;
+        spans.push_back({span, particles, size});
+      }
+    }
+    std::sort(spans.begin(), spans.end(), [](const auto& a, const auto& b) { return a.span < b.span; });
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < spans.size(); i++) {
+      used += spans[i].size;
+      if (i + 1 < spans.size()) {
+        overlapFree &= spans[i].span + spans[i].size * Pool::particleBytes <= spans[i + 1].span;
+      }
+    }
+    passed &= selfCheck("pool spans aligned to their size", aligned);
+    passed &= selfCheck("pool spans do not overlap", overlapFree);
+    passed &= selfCheck("pool used matches its spans", pool.used() == used);
+    for (const auto& span : spans) {
+      pool.release(span.span, span.particles);
+    }
+    passed &= selfCheck("pool merged after random releases", pool.allocate(pool.capacity()) != nullptr);
+  }
+
+  // A capacity of whole blocks that is no power of two starts as the largest aligned spans that fit
+  {
+    Pool pool{3 * Pool::blockSize - 1};
+    passed &= selfCheck("pool capacity rounded to blocks", pool.capacity() == 3 * Pool::blockSize);
+    auto* large = pool.allocate(2 * Pool::blockSize);
+    auto* small = pool.allocate(Pool::blockSize);
+    passed &= selfCheck("pool spans of an uneven capacity", large && small);
+    passed &= selfCheck("pool uneven capacity exhausted", !pool.allocate(Pool::minSpan));
+    pool.release(small, Pool::blockSize);
+    pool.release(large, 2 * Pool::blockSize);
+    passed &= selfCheck("pool span beyond an uneven capacity refused", !pool.allocate(4 * Pool::blockSize));
+    passed &= selfCheck("pool uneven capacity reusable", pool.allocate(2 * Pool::blockSize) != nullptr);
+  }
+
+  // A ring grows until its next span does not fit next to its current one, the released spans merge again
+  {
+    Pool pool{std::size_t{1} << 16};
+    {
+      ParticleStreams streams{&pool};
+      while (streams.push(Pool::minSpan)) {
+      }
+      passed &= selfCheck("ring grows to half of the pool", streams.capacity() == pool.capacity() / 2);
+    }
+    passed &= selfCheck("ring spans merged", pool.allocate(pool.capacity()) != nullptr);
+  }
+  return passed;
+}
+
+auto checkExpiryWheel() -> bool
+{
+  constexpr float dt = 1.f / 60.f;
+  auto passed = true;
+  std::mt19937 rng{13};
+  std::uniform_real_distribution<float> ttl{0.05f, 3.f};
+
+  // Particles are counted until their bucket ended and every one is counted out exactly once
+  ExpiryWheel wheel;
+  std::vector<float> aliveUntil(20000);
+  for (auto& until : aliveUntil) {
+    until = ttl(rng);
+  }
+  const auto allocations = gAllocations.load();
+  std::size_t added = 0;
+  for (auto until : aliveUntil) {
+    added += wheel.add(until) ? 1 : 0;
+  }
+  std::size_t expired = 0;
+  auto bounded = true;
+  for (auto time = dt; time < 1.5f; time += dt) {
+    expired += wheel.expire(time);
+    const auto alive = static_cast<std::size_t>(
+        std::count_if(aliveUntil.begin(), aliveUntil.end(), [&](float until) { return until > time; }));
+    const auto late = static_cast<std::size_t>(std::count_if(aliveUntil.begin(), aliveUntil.end(), [&](float until) {
+      return until > time - 2.f * wheel.bucketSeconds();
+    }));
+    bounded &= wheel.alive() >= alive && wheel.alive() <= late;
+  }
+  passed &= selfCheck("wheel counts every particle", added == aliveUntil.size());
+  passed &= selfCheck("wheel lags at most a bucket", bounded);
+  passed &= selfCheck("wheel expired and alive add up", expired + wheel.alive() == added);
+  passed &= selfCheck("wheel refuses expired particles", !wheel.add(1.f));
+
+  // Removing uncounts alive particles only, an empty wheel is back to the finest buckets
+  std::size_t removed = 0;
+  std::size_t refused = 0;
+  for (auto until : aliveUntil) {
+    (wheel.remove(until) ? removed : refused)++;
+  }
+  passed &= selfCheck("wheel removes the alive particles", removed == added - expired);
+  passed &= selfCheck("wheel empty after removing", wheel.alive() == 0 && refused == expired);
+
+  // Far expiries widen the buckets instead of growing the wheel
+  passed &= selfCheck("wheel counts a far expiry", wheel.add(120.f));
+  passed &= selfCheck("wheel widened for a far expiry",
+                      wheel.bucketSeconds() * ExpiryWheel::bucketCount >= 120.f - 1.5f);
+  passed &= selfCheck("wheel keeps near expiries after widening", wheel.add(1.6f) && wheel.alive() == 2);
+  passed &= selfCheck("wheel expires a near particle after widening", wheel.expire(2.f + wheel.bucketSeconds()) == 1);
+  passed &= selfCheck("wheel removes a far particle", wheel.remove(120.f) && wheel.alive() == 0);
+  passed &= selfCheck("wheel refined when empty", wheel.bucketSeconds() == ExpiryWheel::minBucketSeconds);
+  passed &= selfCheck("wheel counts without the heap", gAllocations.load() == allocations);
+  return passed;
+}
+
+auto parseOptions(int argc, char** argv) -> Options
+{
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    auto hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--out") == 0 && hasValue) {
+      options.outputPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--filter") == 0 && hasValue) {
+      options.filter = argv[++i];
+    } else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+      options.frames = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--samples") == 0 && hasValue) {
+      options.samples = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+      options.threads = static_cast<std::size_t>(std::max(0, std::atoi(argv[++i])));
+    } else if (std::strcmp(argv[i], "--render-shaders") == 0 && hasValue) {
+      options.renderShaders = argv[++i];
+    } else if (std::strcmp(argv[i], "--self-check") == 0) {
+      options.selfCheck = true;
+    } else {
+      std::fprintf(stderr,
+                   "Usage: %s [--out results.json] [--filter name] [--frames count] [--samples count] "
+                   "[--threads count] [--render-shaders directory] [--self-check]\n",
+                   argv[0]);
+      std::exit(1);
+    }
+  }
+  return options;
+}
+
+auto writeJson(const std::vector<Result>& results, const Options& options) -> bool
+{
+  auto* file = std::fopen(options.outputPath.c_str(), "w");
+  if (!file) {
+    std::fprintf(stderr, "Could not open %s for writing\n", options.outputPath.c_str());
+    return false;
+  }
+  std::fprintf(file, "{\n  \"timestep\": %g,\n  \"isa\": \"%s\",\n  \"worker_threads\": %zu,\n  \"results\": [\n",
+               options.timestep, kernels::isaName(kernels::activeIsa()), options.threads);
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    std::fprintf(file,
+                 "    {\"name\": \"%s\", \"kind\": \"%s\", \"storage\": \"%s\", \"frames\": %zu, "
+                 "\"ns_per_particle\": %.4f, \"ms_per_frame\": %.4f, \"average_live_particles\": %.1f, "
+                 "\"allocations_per_frame\": %.2f, \"allocated_bytes_per_frame\": %.1f, "
+                 "\"integrate_ns_per_particle\": %.4f, \"rss_growth_bytes\": %zu",
+                 r.name.c_str(), r.kind.c_str(), r.storage.c_str(), r.frames, r.nsPerParticle, r.msPerFrame,
+                 r.averageLiveParticles, r.allocationsPerFrame, r.allocatedBytesPerFrame, r.integrateNsPerParticle,
+                 r.rssGrowthBytes);
+    if (r.hasCompactError) {
+      const auto& e = r.compactError;
+      std::fprintf(file,
+                   ", \"compact_position_error_max\": %g, \"compact_position_error_mean\": %g, "
+                   "\"compact_velocity_error_max\": %g, \"compact_size_error_max\": %g, "
+                   "\"compact_rotation_error_max\": %g, \"compact_lifetime_error_max\": %g",
+                   e.positionMax, e.positionMean, e.velocityMax, e.sizeMax, e.rotationMax, e.lifetimeMax);
+    }
+    std::fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(file, "  ]\n}\n");
+  std::fclose(file);
+  return true;
+}
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+  auto options = parseOptions(argc, argv);
+  if (options.selfCheck) {
+    const auto poolPassed = checkPool();
+    const auto passed = checkExpiryWheel() && poolPassed;
+    std::printf("self-check %s\n", passed ? "passed" : "failed");
+    return passed ? 0 : 1;
+  }
+  auto selected = [&options](const char* name) {
+    return options.filter.empty() || std::strstr(name, options.filter.c_str()) != nullptr;
+  };
+
+  std::vector<Result> results;
+  if (selected("random_words")) {
+    for (auto& result : runRandomWords(options)) {
+      std::printf("%-36s %10.3f ns/word\n", result.name.c_str(), result.nsPerParticle);
+      results.push_back(std::move(result));
+    }
+  }
+  for (const auto& scenario : samplingScenarios) {
+    if (selected(scenario.name)) {
+      for (auto run : {runSampling, runPhiloxSampling, runTableSampling}) {
+        results.push_back(run(scenario, options));
+        std::printf("%-36s %10.3f ns/sample\n", results.back().name.c_str(), results.back().nsPerParticle);
+      }
+    }
+  }
+  for (const auto& scenario : simulationScenarios) {
+    if (!selected(scenario.name)) {
+      continue;
+    }
+    for (auto storage : {ParticleStorage::Aos, ParticleStorage::Soa}) {
+      results.push_back(runSimulation(scenario, storage, options));
+      const auto& r = results.back();
+      std::printf("%-28s %s %10.3f ns/particle %10.3f ms/frame %10.1f allocs/frame %12zu rss growth\n", scenario.name,
+                  particleStorageName(storage), r.nsPerParticle, r.msPerFrame, r.allocationsPerFrame, r.rssGrowthBytes);
+      if (r.hasCompactError) {
+        std::printf("  compact format error: position max %g mean %g, velocity %g, size %g, rotation %g, "
+                    "lifetime %g\n",
+                    r.compactError.positionMax, r.compactError.positionMean, r.compactError.velocityMax,
+                    r.compactError.sizeMax, r.compactError.rotationMax, r.compactError.lifetimeMax);
+      }
+    }
+  }
+
+  const auto renderSelected =
+      std::any_of(renderScenarios.begin(), renderScenarios.end(), [&](const auto& s) { return selected(s.name); });
+  if (!options.renderShaders.empty() && renderSelected) {
+    HiddenContext context;
+    if (!context.valid()) {
+      std::fprintf(stderr, "Could not create an OpenGL 4.3 context: %s\n", SDL_GetError());
+      return 1;
+    }
+    for (const auto& scenario : renderScenarios) {
+      if (!selected(scenario.name)) {
+        continue;
+      }
+      for (auto expansion : {QuadExpansion::Instanced, QuadExpansion::Pulled}) {
+        auto result = runRender(scenario, expansion, options);
+        if (!result) {
+          std::printf("%-40s not supported by the context\n", scenario.name);
+          continue;
+        }
+        results.push_back(std::move(*result));
+        const auto& r = results.back();
+        std::printf("%-40s %10.3f ns/particle %10.3f ms/frame (GPU) %12.1f particles\n", r.name.c_str(),
+                    r.nsPerParticle, r.msPerFrame, r.averageLiveParticles);
+      }
+    }
+  }
+
+  return writeJson(results, options) ? 0 : 1;
+}
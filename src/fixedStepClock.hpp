@@ -0,0 +1,49 @@
+#pragma once
+
+#include "aw/util/time/time.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+// Turns variable frame times into a whole number of fixed simulation steps. Frame time beyond maxSteps steps is
+// dropped, so a hitch (a blocking file dialog, a level load) costs at most maxSteps steps and never spawns the bursts
+// of the lost time. The remainder below one step is carried to the next frame, renderers add interpolation() to the
+// simulation time to draw the stateless particles at the frame's time.
+class FixedStepClock
+{
+public:
+  static constexpr float defaultStep = 1.f / 60.f;
+  static constexpr std::size_t defaultMaxSteps = 4;
+
+  FixedStepClock(aw::Seconds step = aw::Seconds{defaultStep}, std::size_t maxSteps = defaultMaxSteps) :
+      mStep{step}, mMaxSteps{maxSteps}
+  {
+  }
+
+  // Adds the frame time and returns the number of steps to simulate
+  auto advance(aw::Seconds dt) -> std::size_t
+  {
+    mAccumulated += std::max(dt, aw::Seconds{0.f});
+    auto steps = static_cast<std::size_t>(mAccumulated / mStep);
+    if (steps > mMaxSteps) {
+      mDropped += mAccumulated - mStep * static_cast<float>(mMaxSteps);
+      mAccumulated = mStep * static_cast<float>(mMaxSteps);
+      steps = mMaxSteps;
+    }
+    mAccumulated = std::max(mAccumulated - mStep * static_cast<float>(steps), aw::Seconds{0.f});
+    return steps;
+  }
+
+  auto step() const -> aw::Seconds { return mStep; }
+  void setStep(aw::Seconds step) { mStep = step; }
+  // Time the frame lies past the last simulated step, in [0, step)
+  auto interpolation() const -> float { return mAccumulated.count(); }
+  // Frame time dropped by the catch-up budget so far
+  auto dropped() const -> aw::Seconds { return mDropped; }
+
+private:
+  aw::Seconds mStep;
+  std::size_t mMaxSteps;
+  aw::Seconds mAccumulated{0.f};
+  aw::Seconds mDropped{0.f};
+};
@@ -0,0 +1,82 @@
+#include "glExt.hpp"
+
+#include "SDL_video.h"
+
+namespace glExt {
+namespace {
+using BufferStorageFn = void(GL_APIENTRY*)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+using DispatchComputeFn = void(GL_APIENTRY*)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+using ClearBufferSubDataFn = void(GL_APIENTRY*)(GLenum target, GLenum internalFormat, GLintptr offset,
+                                                GLsizeiptr size, GLenum format, GLenum type, const void* data);
+using MultiDrawArraysIndirectFn = void(GL_APIENTRY*)(GLenum mode, const void* indirect, GLsizei drawCount,
+                                                     GLsizei stride);
+
+template <typename Fn>
+auto load(const char* name) -> Fn
+{
+  return reinterpret_cast<Fn>(SDL_GL_GetProcAddress(name));
+}
+} // namespace
+
+auto hasVersion(int major, int minor) -> bool
+{
+  GLint contextMajor = 0;
+  GLint contextMinor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+  glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+  return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+auto hasBufferStorage() -> bool
+{
+  static const bool supported = (hasVersion(4, 4) || SDL_GL_ExtensionSupported("GL_ARB_buffer_storage")) &&
+                                load<BufferStorageFn>("glBufferStorage") != nullptr;
+  return supported;
+}
+
+void bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+  static const auto fn = load<BufferStorageFn>("glBufferStorage");
+  fn(target, size, data, flags);
+}
+
+auto hasComputeShader() -> bool
+{
+  // The shaders are compiled as GLSL 430, the extensions alone are not enough
+  static const bool supported = hasVersion(4, 3) && load<DispatchComputeFn>("glDispatchCompute") != nullptr;
+  return supported;
+}
+
+void dispatchCompute(GLuint groupsX, GLuint groupsY, GLuint groupsZ)
+{
+  static const auto fn = load<DispatchComputeFn>("glDispatchCompute");
+  fn(groupsX, groupsY, groupsZ);
+}
+
+void clearBufferSubData(GLenum target, GLenum internalFormat, GLintptr offset, GLsizeiptr size, GLenum format,
+                        GLenum type, const void* data)
+{
+  static const auto fn = load<ClearBufferSubDataFn>("glClearBufferSubData");
+  fn(target, internalFormat, offset, size, format, type, data);
+}
+
+auto hasMultiDrawIndirect() -> bool
+{
+  static const bool supported = (hasVersion(4, 3) || SDL_GL_ExtensionSupported("GL_ARB_multi_draw_indirect")) &&
+                                load<MultiDrawArraysIndirectFn>("glMultiDrawArraysIndirect") != nullptr;
+  return supported;
+}
+
+void multiDrawArraysIndirect(GLenum mode, const void* indirect, GLsizei drawCount, GLsizei stride)
+{
+  static const auto fn = load<MultiDrawArraysIndirectFn>("glMultiDrawArraysIndirect");
+  fn(mode, indirect, drawCount, stride);
+}
+
+auto hasShaderDrawParameters() -> bool
+{
+  // Core in GL 4.6 but only as gl_DrawID of GLSL 460, the shaders need the extension
+  static const bool supported = SDL_GL_ExtensionSupported("GL_ARB_shader_draw_parameters");
+  return supported;
+}
+} // namespace glExt
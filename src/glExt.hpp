@@ -0,0 +1,54 @@
+#pragma once
+
+#include "aw/graphics/opengl/gl.hpp"
+
+// OpenGL entry points newer than the GL 4.2 loader in gl.cpp. They are resolved through SDL on first use, callers check
+// the matching has* function before using them.
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
+#endif
+
+namespace glExt {
+// True if the context is at least major.minor
+auto hasVersion(int major, int minor) -> bool;
+
+// GL 4.4 or ARB_buffer_storage
+auto hasBufferStorage() -> bool;
+void bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// GL 4.3 compute shaders and shader storage buffers
+auto hasComputeShader() -> bool;
+void dispatchCompute(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+// GL 4.3 as well, available whenever hasComputeShader() is
+void clearBufferSubData(GLenum target, GLenum internalFormat, GLintptr offset, GLsizeiptr size, GLenum format,
+                        GLenum type, const void* data);
+
+// GL 4.3 or ARB_multi_draw_indirect
+auto hasMultiDrawIndirect() -> bool;
+void multiDrawArraysIndirect(GLenum mode, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+// ARB_shader_draw_parameters, gl_DrawIDARB in GLSL 430 shaders
+auto hasShaderDrawParameters() -> bool;
+} // namespace glExt
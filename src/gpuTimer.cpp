@@ -0,0 +1,52 @@
+#include "gpuTimer.hpp"
+
+GpuTimer::GpuTimer()
+{
+  glGenQueries(static_cast<GLsizei>(latency), mQueries.data());
+}
+
+GpuTimer::~GpuTimer()
+{
+  glDeleteQueries(static_cast<GLsizei>(latency), mQueries.data());
+}
+
+void GpuTimer::begin()
+{
+  collect();
+  if (mPending[mNext]) {
+    return;
+  }
+  glBeginQuery(GL_TIME_ELAPSED, mQueries[mNext]);
+  mRunning = true;
+}
+
+void GpuTimer::end()
+{
+  if (!mRunning) {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  mRunning = false;
+  mPending[mNext] = true;
+  mNext = (mNext + 1) % latency;
+}
+
+void GpuTimer::collect()
+{
+  // Oldest first, queries finish in submission order
+  for (std::size_t i = 0; i < latency; i++) {
+    const auto slot = (mNext + i) % latency;
+    if (!mPending[slot]) {
+      continue;
+    }
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(mQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE) {
+      break;
+    }
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(mQueries[slot], GL_QUERY_RESULT, &nanoseconds);
+    mElapsed = static_cast<float>(static_cast<double>(nanoseconds) * 1e-9);
+    mPending[slot] = false;
+  }
+}
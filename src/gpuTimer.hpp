@@ -0,0 +1,36 @@
+#pragma once
+
+#include "aw/graphics/opengl/gl.hpp"
+
+#include <array>
+#include <cstddef>
+#include <optional>
+
+// GPU time of the commands between begin and end, measured with GL_TIME_ELAPSED queries. Results are read without
+// waiting for the GPU: up to latency queries are in flight, a frame whose query slot is still busy is not measured.
+class GpuTimer
+{
+public:
+  static constexpr std::size_t latency = 4;
+
+  GpuTimer();
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer&) = delete;
+  auto operator=(const GpuTimer&) -> GpuTimer& = delete;
+
+  void begin();
+  void end();
+
+  // Seconds of the newest measured frame, a few frames behind
+  auto elapsed() const -> std::optional<float> { return mElapsed; }
+
+private:
+  void collect();
+
+  std::array<GLuint, latency> mQueries{};
+  std::array<bool, latency> mPending{};
+  std::size_t mNext{0};
+  bool mRunning{false};
+  std::optional<float> mElapsed;
+};
@@ -0,0 +1,114 @@
+#include "gpuVerification.hpp"
+
+#include "SDL.h"
+#include "aw/util/math/transform.hpp"
+#include "entt/entity/registry.hpp"
+#include "hiddenContext.hpp"
+#include "jobPool.hpp"
+#include "particleSystem/gpuSimulation.hpp"
+#include "particleSystem/simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+struct Comparison
+{
+  std::size_t checkpoints{0};
+  std::size_t particles{0};
+  // Groups whose ring tail or head differ
+  std::size_t ringMismatches{0};
+  std::size_t particleMismatches{0};
+};
+
+template <typename T>
+auto bitwiseEqual(const T& a, const T& b) -> bool
+{
+  return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+void compare(const ParticleStreams& cpu, const ParticleStreams& gpu, Comparison& result)
+{
+  if (cpu.tail != gpu.tail || cpu.head != gpu.head) {
+    result.ringMismatches++;
+  }
+  // Capacities may differ, particles are matched by sequence number
+  for (auto sequence = std::max(cpu.tail, gpu.tail); sequence < std::min(cpu.head, gpu.head); sequence++) {
+    const auto c = cpu.slot(sequence);
+    const auto g = gpu.slot(sequence);
+    const auto equal = bitwiseEqual(cpu.positionSize[c], gpu.positionSize[g]) &&
+                       bitwiseEqual(cpu.velocity[c], gpu.velocity[g]) &&
+                       bitwiseEqual(cpu.rotation[c], gpu.rotation[g]) &&
+                       bitwiseEqual(cpu.aliveUntil[c], gpu.aliveUntil[g]) &&
+                       bitwiseEqual(cpu.aliveFor[c], gpu.aliveFor[g]);
+    result.particles++;
+    result.particleMismatches += equal ? 0 : 1;
+  }
+}
+
+void compare(const ParticleSimulation& cpu, const GpuParticleSimulation& gpu, Comparison& result)
+{
+  result.checkpoints++;
+  for (const auto& group : cpu.particles()) {
+    compare(group.streams, gpu.readBack(group.spawner), result);
+  }
+  // ParticleSimulation drops the group of a removed spawner as soon as it is empty
+  for (const auto& group : gpu.groups()) {
+    const auto& particles = cpu.particles();
+    const auto cpuGroup = std::find_if(particles.begin(), particles.end(),
+                                       [&group](const auto& element) { return element.spawner == group.spawner; });
+    if (group.spawner != entt::null && cpuGroup == particles.end() && !gpu.readBack(group.spawner).empty()) {
+      result.ringMismatches++;
+    }
+  }
+}
+} // namespace
+
+auto runGpuVerification(const HeadlessOptions& options, const aw::ParticleSpawner& spawner) -> int
+{
+  HiddenContext context;
+  if (!context.valid()) {
+    std::fprintf(stderr, "Could not create an OpenGL 4.3 context: %s\n", SDL_GetError());
+    return 1;
+  }
+  if (!GpuParticleSimulation::supported()) {
+    std::fprintf(stderr, "The OpenGL context does not support compute shaders\n");
+    return 1;
+  }
+
+  entt::registry world;
+  auto entity = world.create();
+  world.assign<aw::Transform>(entity);
+  world.assign<aw::ParticleSpawner>(entity, spawner);
+
+  JobPool jobs{options.threads};
+  ParticleSimulation cpu{world, jobs, options.seed, options.poolCapacity};
+  GpuParticleSimulation gpu{world, options.verifyGpuShaders, options.seed};
+  if (!gpu.valid()) {
+    std::fprintf(stderr, "Failed to load the compute shaders from %s\n", options.verifyGpuShaders.string().c_str());
+    return 1;
+  }
+
+  // Reading the pool back stalls the GPU, particles are compared once per simulated second and after the last step
+  const auto steps = static_cast<std::size_t>(options.seconds / options.timestep);
+  const auto stepsPerSecond = static_cast<std::size_t>(std::lround(1.f / options.timestep));
+  const auto checkpointInterval = std::max<std::size_t>(1, stepsPerSecond);
+  Comparison result;
+  for (std::size_t i = 1; i <= steps; i++) {
+    cpu.update(aw::Seconds{options.timestep});
+    gpu.update(aw::Seconds{options.timestep});
+    if (i % checkpointInterval == 0 || i == steps) {
+      compare(cpu, gpu, result);
+    }
+  }
+
+  std::printf("spawner: %s\n", options.spawnerPath.string().c_str());
+  std::printf("seed: %u\n", options.seed);
+  std::printf("steps: %zu (timestep %.6fs)\n", steps, options.timestep);
+  std::printf("gpu verification: %zu checkpoints, %zu particles compared, %zu ring mismatches, "
+              "%zu particle mismatches\n",
+              result.checkpoints, result.particles, result.ringMismatches, result.particleMismatches);
+  return result.ringMismatches == 0 && result.particleMismatches == 0 ? 0 : 1;
+}
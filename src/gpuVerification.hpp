@@ -0,0 +1,9 @@
+#pragma once
+
+#include "aw/engine/particleSystem/spawner.hpp"
+#include "headlessSimulation.hpp"
+
+// Runs GpuParticleSimulation and ParticleSimulation side by side with the same seed and compares every resident
+// particle bit for bit once per second of simulated time. Needs a GL 4.3 context but no visible window, so it also runs
+// on Mesa's llvmpipe (e.g. SDL_VIDEODRIVER=offscreen). Returns 0 if every particle matched.
+auto runGpuVerification(const HeadlessOptions& options, const aw::ParticleSpawner& spawner) -> int;
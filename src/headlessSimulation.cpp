@@ -0,0 +1,261 @@
+#include "headlessSimulation.hpp"
+
+#include "aw/engine/particleSystem/spawner.serialize.hpp"
+#include "aw/util/math/transform.hpp"
+#include "aw/util/serialization/serialze.hpp"
+#include "entt/entity/helper.hpp"
+#include "gpuVerification.hpp"
+#include "particleSystem/instanceFormat.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+auto parseHeadlessOptions(int argc, char** argv) -> std::optional<HeadlessOptions>
+{
+  std::optional<HeadlessOptions> options;
+  for (int i = 1; i < argc; i++) {
+    auto hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--headless") == 0 && hasValue) {
+      options.emplace();
+      options->spawnerPath = argv[++i];
+    }
+  }
+  if (!options) {
+    return options;
+  }
+  for (int i = 1; i < argc; i++) {
+    auto hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      options->seconds = std::strtof(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--timestep") == 0 && hasValue) {
+      options->timestep = std::strtof(argv[++i], nullptr);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+      options->threads = static_cast<std::size_t>(std::max(0, std::atoi(argv[++i])));
+    } else if (std::strcmp(argv[i], "--storage") == 0 && hasValue) {
+      options->storage = std::strcmp(argv[++i], "aos") == 0 ? ParticleStorage::Aos : ParticleStorage::Soa;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && hasValue) {
+      options->seed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--pool-capacity") == 0 && hasValue) {
+      options->poolCapacity = static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--particle-budget") == 0 && hasValue) {
+      options->particleBudget = static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--trace-frames") == 0 && hasValue) {
+      options->traceFrames = static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--spawner-costs") == 0) {
+      options->spawnerCosts = true;
+    } else if (std::strcmp(argv[i], "--verify-gpu") == 0 && hasValue) {
+      options->verifyGpuShaders = argv[++i];
+    }
+  }
+  return options;
+}
+
+HeadlessSimulation::HeadlessSimulation(const aw::ParticleSpawner& spawner, ParticleStorage storage,
+                                       std::size_t threads, std::uint32_t seed, std::size_t poolCapacity,
+                                       std::size_t particleBudget) :
+    mStorage{storage},
+    mJobs{threads},
+    mEngineParticleSystem{mWorld},
+    mParticleSystem{mWorld, mJobs, seed, poolCapacity},
+    mSpawner{mWorld.create()}
+{
+  mWorld.assign<aw::Transform>(mSpawner);
+  mWorld.assign<aw::ParticleSpawner>(mSpawner, spawner);
+  mParticleSystem.setParticleBudget(particleBudget);
+}
+
+auto HeadlessSimulation::run(float seconds, float timestep) -> HeadlessReport
+{
+  using Clock = std::chrono::steady_clock;
+
+  HeadlessReport report;
+  const auto steps = static_cast<std::size_t>(seconds / timestep);
+  for (std::size_t i = 0; i < steps; i++) {
+    const auto previousTime = simulationTime();
+
+    const auto begin = Clock::now();
+    update(timestep);
+    report.updateSeconds += std::chrono::duration<double>(Clock::now() - begin).count();
+    if (mProfiler.tracing()) {
+      mProfiler.endFrame();
+    }
+
+    const auto live = liveParticles();
+    report.particleUpdates += live;
+    report.spawnedParticles += spawnedSince(previousTime);
+    report.peakLiveParticles = std::max(report.peakLiveParticles, live);
+
+    const auto pool = mParticleSystem.pool().counters();
+    report.pool.allocations += pool.allocations;
+    report.pool.recycled += pool.recycled;
+    report.pool.releases += pool.releases;
+    report.pool.failed += pool.failed;
+    report.throttledParticles += mParticleSystem.stats().throttled;
+    report.evictedParticles += mParticleSystem.stats().evicted;
+  }
+  report.steps = steps;
+  report.simulatedSeconds = static_cast<float>(steps) * timestep;
+  report.stateChecksum = stateChecksum();
+  if (mStorage == ParticleStorage::Soa) {
+    report.poolUsed = mParticleSystem.pool().used();
+    report.poolCarved = mParticleSystem.pool().carved();
+    report.compactError = measureCompactError(mParticleSystem.particles(), mParticleSystem.simulationTime());
+  }
+  if (mStorage == ParticleStorage::Soa && mParticleSystem.spawnerCosts()) {
+    for (const auto& group : mParticleSystem.particles()) {
+      report.spawners.push_back(
+          {static_cast<std::uint32_t>(group.spawner), group.cost, group.expiry.alive(), estimatedFillArea(group)});
+    }
+    std::sort(report.spawners.begin(), report.spawners.end(), [](const auto& a, const auto& b) {
+      return a.cost.updateNanoseconds + a.cost.spawnNanoseconds > b.cost.updateNanoseconds + b.cost.spawnNanoseconds;
+    });
+  }
+  return report;
+}
+
+void HeadlessSimulation::setTraceFrames(std::size_t steps)
+{
+  mProfiler.setTraceFrames(steps);
+  mParticleSystem.setProfiler(steps > 0 ? &mProfiler : nullptr);
+}
+
+auto HeadlessSimulation::writeTrace(const aw::fs::path& path) const -> bool
+{
+  return mProfiler.writeChromeTrace(path);
+}
+
+void HeadlessSimulation::update(float dt)
+{
+  if (mStorage == ParticleStorage::Aos) {
+    mEngineParticleSystem.update(aw::Seconds{dt}, entt::as_view(mWorld));
+  } else {
+    mParticleSystem.update(aw::Seconds{dt});
+  }
+}
+
+auto HeadlessSimulation::simulationTime() const -> float
+{
+  return mStorage == ParticleStorage::Aos ? mEngineParticleSystem.simulationTime() : mParticleSystem.simulationTime();
+}
+
+auto HeadlessSimulation::liveParticles() const -> std::size_t
+{
+  if (mStorage == ParticleStorage::Aos) {
+    const auto& p = mEngineParticleSystem.particles();
+    return std::accumulate(p.begin(), p.end(), std::size_t{0},
+                           [](auto sum, auto& element) { return sum + element.particles.size(); });
+  }
+  return mParticleSystem.stats().live;
+}
+
+auto HeadlessSimulation::spawnedSince(float time) const -> std::size_t
+{
+  if (mStorage == ParticleStorage::Soa) {
+    return mParticleSystem.stats().spawned;
+  }
+  // The engine's particles are immutable after spawn, aliveUntil - aliveFor is their spawn time. The engine does not
+  // promise any order of its particles, so every one is visited. Costs O(live) per step, outside the timed update.
+  std::size_t spawned = 0;
+  for (const auto& group : mEngineParticleSystem.particles()) {
+    const auto& particles = group.particles;
+    spawned += static_cast<std::size_t>(std::count_if(particles.begin(), particles.end(), [time](const auto& p) {
+      return p.velocityAliveUntilAliveFor.z - p.velocityAliveUntilAliveFor.w > time;
+    }));
+  }
+  return spawned;
+}
+
+auto HeadlessSimulation::stateChecksum() const -> std::uint64_t
+{
+  if (mStorage == ParticleStorage::Aos) {
+    return 0;
+  }
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  auto append = [&hash](const void* data, std::size_t size) {
+    for (std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 0x100000001b3ull;
+    }
+  };
+  for (const auto& group : mParticleSystem.particles()) {
+    const auto& streams = group.streams;
+    for (auto sequence = streams.tail; sequence < streams.head; sequence++) {
+      const auto i = streams.slot(sequence);
+      append(&streams.positionSize[i], sizeof(streams.positionSize[i]));
+      append(&streams.velocity[i], sizeof(streams.velocity[i]));
+      append(&streams.rotation[i], sizeof(float));
+      append(&streams.aliveUntil[i], sizeof(float));
+    }
+  }
+  return hash;
+}
+
+auto runHeadless(const HeadlessOptions& options) -> int
+{
+  if (options.timestep <= 0.f || options.seconds <= 0.f) {
+    std::fprintf(stderr, "Invalid headless options: --seconds and --timestep have to be positive\n");
+    return 1;
+  }
+  if (!aw::fs::exists(options.spawnerPath)) {
+    std::fprintf(stderr, "Particle spawner file not found: %s\n", options.spawnerPath.string().c_str());
+    return 1;
+  }
+
+  auto spawner = aw::parse::file<aw::ParticleSpawner>(options.spawnerPath);
+  if (!options.verifyGpuShaders.empty()) {
+    return runGpuVerification(options, spawner);
+  }
+  HeadlessSimulation simulation{
+      spawner, options.storage, options.threads, options.seed, options.poolCapacity, options.particleBudget};
+  if (options.traceFrames > 0 && options.storage == ParticleStorage::Soa) {
+    simulation.setTraceFrames(options.traceFrames);
+  }
+  simulation.setSpawnerCosts(options.spawnerCosts);
+  auto report = simulation.run(options.seconds, options.timestep);
+
+  auto updateSeconds = std::max(report.updateSeconds, 1e-9);
+  std::printf("spawner: %s\n", options.spawnerPath.string().c_str());
+  std::printf("storage: %s\n", particleStorageName(options.storage));
+  std::printf("worker threads: %zu\n", options.threads);
+  std::printf("seed: %u\n", options.seed);
+  std::printf("steps: %zu (timestep %.6fs, simulated %.3fs)\n", report.steps, options.timestep,
+              report.simulatedSeconds);
+  std::printf("update time: %.6fs\n", report.updateSeconds);
+  std::printf("particles updated per second: %.0f\n", static_cast<double>(report.particleUpdates) / updateSeconds);
+  std::printf("spawn rate: %.1f particles/simulated second\n",
+              static_cast<double>(report.spawnedParticles) / report.simulatedSeconds);
+  std::printf("peak live particles: %zu\n", report.peakLiveParticles);
+  if (options.storage == ParticleStorage::Soa) {
+    std::printf("state checksum: %016llx\n", static_cast<unsigned long long>(report.stateChecksum));
+    const auto& e = report.compactError;
+    std::printf("compact instance error: position max %g mean %g, velocity %g, size %g, rotation %g, lifetime %g\n",
+                e.positionMax, e.positionMean, e.velocityMax, e.sizeMax, e.rotationMax, e.lifetimeMax);
+    const auto& pool = report.pool;
+    std::printf("particle pool: %zu used, %zu carved of %zu\n", report.poolUsed, report.poolCarved,
+                options.poolCapacity);
+    std::printf("pool spans: %zu allocations (%zu recycled), %zu releases, %zu failed\n", pool.allocations,
+                pool.recycled, pool.releases, pool.failed);
+    if (options.particleBudget > 0) {
+      std::printf("particle budget: %zu, %zu throttled, %zu evicted\n", options.particleBudget,
+                  report.throttledParticles, report.evictedParticles);
+    }
+    for (const auto& spawner : report.spawners) {
+      const auto steps = static_cast<double>(std::max<std::size_t>(spawner.cost.updates, 1));
+      std::printf("spawner %u: %.3f us update, %.3f us spawn per step, %zu live, fill area %.2f\n", spawner.entity,
+                  static_cast<double>(spawner.cost.updateNanoseconds) * 1e-3 / steps,
+                  static_cast<double>(spawner.cost.spawnNanoseconds) * 1e-3 / steps, spawner.live,
+                  static_cast<double>(spawner.fillArea));
+    }
+    if (options.traceFrames > 0) {
+      if (!simulation.writeTrace(HeadlessSimulation::traceFile)) {
+        std::fprintf(stderr, "Failed to write %s\n", HeadlessSimulation::traceFile);
+        return 1;
+      }
+      std::printf("trace: %zu steps written to %s\n", options.traceFrames, HeadlessSimulation::traceFile);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "aw/engine/particleSystem/spawner.hpp"
+#include "aw/engine/particleSystem/system.hpp"
+#include "aw/util/filesystem/fileStream.hpp"
+#include "entt/entity/registry.hpp"
+#include "jobPool.hpp"
+#include "particleSystem/instanceFormat.hpp"
+#include "particleSystem/simulation.hpp"
+#include "profiler.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+struct HeadlessOptions
+{
+  aw::fs::path spawnerPath;
+  ParticleStorage storage{ParticleStorage::Soa};
+  float seconds{10.f};
+  float timestep{1.f / 60.f};
+  std::size_t threads{JobPool::defaultWorkerCount()};
+  std::uint32_t seed{0};
+  // Particles of the soa storage's ParticlePool
+  std::size_t poolCapacity{ParticlePool::defaultCapacity};
+  // Live particle cap of the soa storage, 0 is unlimited
+  std::size_t particleBudget{0};
+  // "--trace-frames <steps>": Chrome trace of the last steps to HeadlessSimulation::traceFile, soa storage only
+  std::size_t traceFrames{0};
+  // "--spawner-costs": reports the cost of every spawner, soa storage only
+  bool spawnerCosts{false};
+  // "--verify-gpu <shader directory>": compares GpuParticleSimulation against ParticleSimulation instead
+  aw::fs::path verifyGpuShaders;
+};
+
+// Returns std::nullopt if "--headless" was not passed on the command line
+auto parseHeadlessOptions(int argc, char** argv) -> std::optional<HeadlessOptions>;
+
+struct HeadlessReport
+{
+  std::size_t steps{0};
+  float simulatedSeconds{0.f};
+  double updateSeconds{0.0};
+  std::size_t particleUpdates{0};
+  std::size_t spawnedParticles{0};
+  std::size_t peakLiveParticles{0};
+  // FNV-1a over the resident particles of the soa storage after the last step, equal for equal seeds
+  std::uint64_t stateChecksum{0};
+  // Pool operations summed over the steps and the particles in spans after the last step, soa storage only
+  ParticlePool::Counters pool;
+  std::size_t poolUsed{0};
+  std::size_t poolCarved{0};
+  // Particles dropped by the particle budget, summed over the steps
+  std::size_t throttledParticles{0};
+  std::size_t evictedParticles{0};
+  // Precision cost of InstanceFormat::Compact for the resident particles after the last step, soa storage only
+  CompactError compactError;
+  // With spawner costs enabled, summed over the steps and sorted by CPU time, the most expensive spawner first
+  struct Spawner
+  {
+    std::uint32_t entity;
+    SpawnerCost cost;
+    // After the last step
+    std::size_t live;
+    float fillArea;
+  };
+  std::vector<Spawner> spawners;
+};
+
+// Drives the particle simulation without a window, GL context or ImGui
+class HeadlessSimulation
+{
+public:
+  HeadlessSimulation(const aw::ParticleSpawner& spawner, ParticleStorage storage, std::size_t threads,
+                     std::uint32_t seed, std::size_t poolCapacity = ParticlePool::defaultCapacity,
+                     std::size_t particleBudget = 0);
+
+  auto run(float seconds, float timestep) -> HeadlessReport;
+
+  // Keeps the profiler events of the last steps of run, soa storage only
+  void setTraceFrames(std::size_t steps);
+  auto writeTrace(const aw::fs::path& path) const -> bool;
+
+  static constexpr const char* traceFile = "particleTrace.json";
+
+  // Fills HeadlessReport::spawners, soa storage only
+  void setSpawnerCosts(bool enabled) { mParticleSystem.setSpawnerCosts(enabled); }
+
+private:
+  auto liveParticles() const -> std::size_t;
+  // Particles spawned by the last step, which started at time. Read from the counters of the soa storage, the aos
+  // storage scans all of its particles.
+  auto spawnedSince(float time) const -> std::size_t;
+  auto stateChecksum() const -> std::uint64_t;
+
+  void update(float dt);
+  auto simulationTime() const -> float;
+
+private:
+  ParticleStorage mStorage;
+
+  entt::registry mWorld;
+
+  JobPool mJobs;
+
+  aw::ParticleSystem mEngineParticleSystem;
+  ParticleSimulation mParticleSystem;
+  Profiler mProfiler;
+
+  entt::entity mSpawner;
+};
+
+auto runHeadless(const HeadlessOptions& options) -> int;
@@ -0,0 +1,27 @@
+#include "hiddenContext.hpp"
+
+HiddenContext::HiddenContext()
+{
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    return;
+  }
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+  mWindow = SDL_CreateWindow("awParticleEditor", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1, 1,
+                             SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (mWindow) {
+    mContext = SDL_GL_CreateContext(mWindow);
+  }
+}
+
+HiddenContext::~HiddenContext()
+{
+  if (mContext) {
+    SDL_GL_DeleteContext(mContext);
+  }
+  if (mWindow) {
+    SDL_DestroyWindow(mWindow);
+  }
+  SDL_Quit();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "SDL.h"
+
+// Hidden 1x1 window owning a GL 4.3 core context, for GL work without a visible window (e.g. SDL_VIDEODRIVER=offscreen
+// with Mesa's llvmpipe). Initializes SDL's video subsystem and quits SDL again when destroyed.
+class HiddenContext
+{
+public:
+  HiddenContext();
+  ~HiddenContext();
+
+  HiddenContext(const HiddenContext&) = delete;
+  auto operator=(const HiddenContext&) -> HiddenContext& = delete;
+
+  auto valid() const -> bool { return mContext != nullptr; }
+
+private:
+  SDL_Window* mWindow{nullptr};
+  SDL_GLContext mContext{nullptr};
+};
@@ -0,0 +1,115 @@
+#include "jobPool.hpp"
+
+#include <algorithm>
+
+JobPool::JobPool(std::size_t workerCount)
+{
+  // The last queue belongs to the thread calling parallelFor
+  for (std::size_t i = 0; i <= workerCount; i++) {
+    mQueues.push_back(std::make_unique<Queue>());
+  }
+  for (std::size_t i = 0; i < workerCount; i++) {
+    mWorkers.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+JobPool::~JobPool()
+{
+  {
+    std::lock_guard lock(mWakeMutex);
+    mStop = true;
+  }
+  mWake.notify_all();
+  for (auto& worker : mWorkers) {
+    worker.join();
+  }
+}
+
+auto JobPool::defaultWorkerCount() -> std::size_t
+{
+  const auto hardwareThreads = static_cast<std::size_t>(std::thread::hardware_concurrency());
+  return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+void JobPool::run(std::size_t count, std::size_t grain, RangeFn fn, void* context)
+{
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<std::size_t>(grain, 1);
+  if (mWorkers.empty() || count <= grain) {
+    fn(context, 0, count);
+    return;
+  }
+
+  const auto taskCount = (count + grain - 1) / grain;
+  mPending.store(taskCount);
+  for (std::size_t i = 0; i < taskCount; i++) {
+    auto& queue = *mQueues[i % mQueues.size()];
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back({fn, context, i * grain, std::min(count, (i + 1) * grain)});
+  }
+  {
+    std::lock_guard lock(mWakeMutex);
+    mGeneration++;
+  }
+  mWake.notify_all();
+
+  Task task;
+  while (pop(mWorkers.size(), task)) {
+    execute(task);
+  }
+
+  std::unique_lock lock(mWakeMutex);
+  mDone.wait(lock, [this] { return mPending.load() == 0; });
+}
+
+auto JobPool::pop(std::size_t queue, Task& task) -> bool
+{
+  {
+    auto& own = *mQueues[queue];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < mQueues.size(); i++) {
+    auto& victim = *mQueues[(queue + i) % mQueues.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobPool::execute(const Task& task)
+{
+  task.fn(task.context, task.begin, task.end);
+  if (mPending.fetch_sub(1) == 1) {
+    std::lock_guard lock(mWakeMutex);
+    mDone.notify_all();
+  }
+}
+
+void JobPool::workerLoop(std::size_t index)
+{
+  std::uint64_t seenGeneration = 0;
+  for (;;) {
+    Task task;
+    while (pop(index, task)) {
+      execute(task);
+    }
+
+    std::unique_lock lock(mWakeMutex);
+    mWake.wait(lock, [&] { return mStop || mGeneration != seenGeneration; });
+    if (mStop) {
+      return;
+    }
+    seenGeneration = mGeneration;
+  }
+}
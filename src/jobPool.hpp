@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads with one task queue each. Workers pop from the back of their own queue and steal
+// from the front of the others when it runs empty. The thread calling parallelFor participates with its own queue.
+// parallelFor must not be called concurrently or from inside a job.
+class JobPool
+{
+public:
+  // A pool without workers runs every job on the calling thread
+  JobPool(std::size_t workerCount);
+  ~JobPool();
+
+  JobPool(const JobPool&) = delete;
+  auto operator=(const JobPool&) -> JobPool& = delete;
+
+  auto workerCount() const -> std::size_t { return mWorkers.size(); }
+
+  // Calls job(i) for every i in [0, count) and returns once all calls finished.
+  // Indices are handed out in ranges of at most grain elements.
+  template <typename Job>
+  void parallelFor(std::size_t count, std::size_t grain, Job&& job)
+  {
+    using JobType = std::remove_reference_t<Job>;
+    auto range = [](void* context, std::size_t begin, std::size_t end) {
+      auto& j = *static_cast<JobType*>(context);
+      for (auto i = begin; i < end; i++) {
+        j(i);
+      }
+    };
+    run(count, grain, range, const_cast<std::remove_const_t<JobType>*>(&job));
+  }
+
+  static auto defaultWorkerCount() -> std::size_t;
+
+private:
+  using RangeFn = void (*)(void* context, std::size_t begin, std::size_t end);
+
+  struct Task
+  {
+    RangeFn fn;
+    void* context;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void run(std::size_t count, std::size_t grain, RangeFn fn, void* context);
+  auto pop(std::size_t queue, Task& task) -> bool;
+  void execute(const Task& task);
+  void workerLoop(std::size_t index);
+
+private:
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::vector<std::thread> mWorkers;
+
+  std::atomic<std::size_t> mPending{0};
+
+  std::mutex mWakeMutex;
+  std::condition_variable mWake;
+  std::condition_variable mDone;
+  std::uint64_t mGeneration{0};
+  bool mStop{false};
+};
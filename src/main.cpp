@@ -1,13 +1,35 @@
 #include "aw/engine/engine.hpp"
+#include "headlessSimulation.hpp"
 #include "particleEditorState.hpp"
 
 #include "aw/util/log.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// "--trace-frames <frames>", 0 if not passed
+auto parseTraceFrames(int argc, char** argv) -> std::size_t
+{
+  for (int i = 1; i + 1 < argc; i++) {
+    if (std::strcmp(argv[i], "--trace-frames") == 0) {
+      return static_cast<std::size_t>(std::strtoull(argv[i + 1], nullptr, 10));
+    }
+  }
+  return 0;
+}
+} // namespace
+
 auto main(int argc, char** argv) -> int
 {
+  // Headless runs bypass the engine entirely, only --verify-gpu creates a hidden GL context of its own
+  if (auto headless = parseHeadlessOptions(argc, argv)) {
+    return runHeadless(*headless);
+  }
+
   aw::Engine engine(argc, argv, "awParticleEditor");
 
-  engine.stateMachine().pushState(std::make_unique<ParticleEditorState>(engine));
+  engine.stateMachine().pushState(std::make_unique<ParticleEditorState>(engine, parseTraceFrames(argc, argv)));
 
   engine.run();
 
@@ -16,16 +16,21 @@
 #include "imgui/imgui_demo.cpp"
 #include "imgui/imgui_impl_opengl3.h"
 #include "imgui/imgui_impl_sdl.h"
+#include "particleSystem/lod.hpp"
 
-#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 
-ParticleEditorState::ParticleEditorState(aw::Engine& engine) :
+ParticleEditorState::ParticleEditorState(aw::Engine& engine, std::size_t traceFrames) :
     aw::State{engine.stateMachine()},
     Subscriber{engine.messageBus()},
     mEngine{engine},
-    mParticleSystem{mWorld},
+    mJobs{JobPool::defaultWorkerCount()},
+    mParticleSystem{mWorld, mJobs},
     mSpawner{mWorld.create()},
-    mParticleRenderer{engine.pathRegistry(), engine.window().size()}
+    mParticleRenderer{engine.pathRegistry().assetPath() / "shaders"}
 {
   glClearColor(0.0f, 0.0f, 0.0f, 1.0);
 
@@ -40,19 +45,39 @@ ParticleEditorState::ParticleEditorState(aw::Engine& engine) :
 
   mWorld.assign<aw::Transform>(mSpawner);
   mWorld.assign<aw::ParticleSpawner>(mSpawner);
+  mWorld.assign<SpawnerLod>(mSpawner);
+
+  mParticleSystem.setProfiler(&mProfiler);
+  mParticleRenderer.setProfiler(&mProfiler);
+  mProfiler.setTraceFrames(traceFrames);
+  mTraceCountdown = traceFrames;
 }
 
 void ParticleEditorState::update(aw::Seconds dt)
 {
-  if (mDropNextFrame) {
-    mDropNextFrame = false;
-    return;
+  // A frame is the update and render of the engine loop, the previous one ends here
+  mProfiler.endFrame();
+  if (mTraceCountdown > 0 && --mTraceCountdown == 0) {
+    writeTrace();
+    mProfiler.setTraceFrames(0);
+  }
+
+  ProfileScope profileUpdate{&mProfiler, "editor update"};
+  // The long frame after a blocking file dialog is capped by the clock's catch-up budget
+  const auto steps = mClock.advance(dt);
+  for (std::size_t i = 0; i < steps; i++) {
+    if (mGpuParticleSystem) {
+      ProfileScope profileSimulation{&mProfiler, "simulation update"};
+      mGpuParticleSystem->update(mClock.step());
+    } else {
+      mParticleSystem.update(mClock.step());
+    }
   }
-  mParticleSystem.update(dt, entt::as_view(mWorld));
 }
 
 void ParticleEditorState::render()
 {
+  ProfileScope profileRender{&mProfiler, "editor render"};
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
   glViewport(0, 0, mEngine.window().size().x, mEngine.window().size().y);
@@ -65,7 +90,19 @@ void ParticleEditorState::render()
   auto t = mWorld.get<aw::Transform>(mSpawner);
   auto mvp = t.transform() * vp;
 
-  mParticleRenderer.render(vp, mParticleSystem.simulationTime(), mParticleSystem.particles());
+  mParticlePassTimer.begin();
+  if (mGpuParticleSystem) {
+    mParticleRenderer.render(vp, *mGpuParticleSystem, mClock.interpolation());
+  } else {
+    mParticleRenderer.render(vp, mParticleSystem.simulationTime() + mClock.interpolation(),
+                             mParticleSystem.particles());
+    // The camera of the orthographic view sits at the origin, the next update picks the spawner detail for it
+    mParticleSystem.setLodView(LodView{{0.f, 0.f, 0.f}, mParticleRenderer.cullView()});
+  }
+  mParticlePassTimer.end();
+  if (const auto elapsed = mParticlePassTimer.elapsed()) {
+    mProfiler.record("particle pass (GPU)", *elapsed);
+  }
 
   ImGui_ImplOpenGL3_NewFrame();
   ImGui_ImplSDL2_NewFrame(mEngine.window().handle());
@@ -75,10 +112,80 @@ void ParticleEditorState::render()
 
   ImGui::Begin("Spawner Properties", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 
-  const auto& p = mParticleSystem.particles();
-  auto numParticles =
-      std::accumulate(p.begin(), p.end(), 0, [](auto sum, auto& element) { return sum + element.particles.size(); });
-  ImGui::Text("Active particles: %d", numParticles);
+  auto backend = mGpuParticleSystem ? 1 : 0;
+  if (ImGui::Combo("Simulation", &backend, "CPU\0GPU compute\0")) {
+    // The backends do not share particles, the GPU one starts empty
+    mGpuParticleSystem.reset();
+    if (backend == 1 && GpuParticleSimulation::supported()) {
+      mGpuParticleSystem = std::make_unique<GpuParticleSimulation>(
+          mWorld, mEngine.pathRegistry().assetPath() / "shaders", mParticleSystem.seed());
+      if (!mGpuParticleSystem->valid()) {
+        mGpuParticleSystem.reset();
+      }
+    }
+  }
+
+  // Bursts are spawned at their due time within a step, low tick rates only save simulation time
+  auto tickRate = static_cast<int>(std::lround(1.f / mClock.step().count()));
+  if (ImGui::SliderInt("Tick rate (Hz)", &tickRate, 10, 120)) {
+    mClock.setStep(aw::Seconds{1.f / static_cast<float>(tickRate)});
+  }
+  ImGui::Text("Dropped by hitches: %.2fs", static_cast<double>(mClock.dropped().count()));
+
+  auto expansion = static_cast<int>(mParticleRenderer.quadExpansion());
+  if (ImGui::Combo("Quad expansion", &expansion, "Instanced\0Pulled sprites\0")) {
+    mParticleRenderer.setQuadExpansion(static_cast<QuadExpansion>(expansion));
+  }
+  auto culling = mParticleRenderer.culling();
+  if (ImGui::Checkbox("Culling", &culling)) {
+    mParticleRenderer.setCulling(culling);
+  }
+  if (culling) {
+    auto minPixelSize = mParticleRenderer.minPixelSize();
+    if (ImGui::SliderFloat("Min particle size (px)", &minPixelSize, 0.f, 4.f)) {
+      mParticleRenderer.setMinPixelSize(minPixelSize);
+    }
+    ImGui::Text("Culled: %zu particles", mParticleRenderer.culledParticles());
+  }
+
+  if (mGpuParticleSystem) {
+    ImGui::Text("Resident particles: at most %zu", mGpuParticleSystem->residentBound());
+    ImGui::Text("Uploaded: %.1f KiB/frame", static_cast<double>(mGpuParticleSystem->uploadedBytes()) / 1024.0);
+    ImGui::Text("Draw calls: %zu", mParticleRenderer.drawCalls());
+  } else {
+    const auto& stats = mParticleSystem.stats();
+    ImGui::Text("Active particles: %zu (peak %zu, %.1f MiB)", stats.live, stats.peakLive,
+                static_cast<double>(stats.bytes) / (1024.0 * 1024.0));
+    ImGui::Text("Spawned: %zu, retired: %zu per step", stats.spawned, stats.retired);
+    auto budget = static_cast<int>(mParticleSystem.particleBudget());
+    if (ImGui::DragInt("Particle budget (0: off)", &budget, 100.f, 0, 10000000)) {
+      mParticleSystem.setParticleBudget(static_cast<std::size_t>(std::max(budget, 0)));
+    }
+    if (budget > 0) {
+      ImGui::Text("Budget: %.0f%% used, %zu throttled, %zu evicted", static_cast<double>(stats.live) * 100.0 / budget,
+                  stats.throttled, stats.evicted);
+    }
+    const auto& pool = mParticleSystem.pool();
+    const auto counters = pool.counters();
+    ImGui::Text("Pool: %zu used, %zu carved of %zu", pool.used(), pool.carved(), pool.capacity());
+    ImGui::Text("Pool spans: %zu allocated (%zu recycled), %zu failed", counters.allocations, counters.recycled,
+                counters.failed);
+
+    auto upload = static_cast<int>(mParticleRenderer.instanceUpload());
+    if (ImGui::Combo("Instance upload", &upload, "Repack all\0Append spawned\0")) {
+      mParticleRenderer.setInstanceUpload(static_cast<InstanceUpload>(upload));
+    }
+    auto format = static_cast<int>(mParticleRenderer.instanceFormat());
+    if (ImGui::Combo("Instance format", &format, "Float (36 bytes)\0Compact (20 bytes)\0")) {
+      mParticleRenderer.setInstanceFormat(static_cast<InstanceFormat>(format));
+    }
+    auto submission = static_cast<int>(mParticleRenderer.drawSubmission());
+    if (ImGui::Combo("Draw submission", &submission, "Direct\0Indirect\0")) {
+      mParticleRenderer.setDrawSubmission(static_cast<DrawSubmission>(submission));
+    }
+    ImGui::Text("Uploaded: %.1f KiB/frame", static_cast<double>(mParticleRenderer.uploadedBytes()) / 1024.0);
+    ImGui::Text("Draw calls: %zu", mParticleRenderer.drawCalls());
+  }
 
   auto modelNormalDistribution = [this](std::normal_distribution<float>& dist, const char* name, float speed = 0.1f,
                                         float min = 0.f, float max = 100.f, float scale = 1.f, float unScale = 1.f) {
@@ -164,6 +271,42 @@ void ParticleEditorState::render()
   ImGui::ColorEdit4("Begin", &spawner.colorGradient[0].r);
   ImGui::ColorEdit4("End", &spawner.colorGradient[1].r);
 
+  ImGui::Separator();
+  auto& lod = mWorld.get<SpawnerLod>(mSpawner);
+  ImGui::DragFloat("Sleep distance", &lod.sleepDistance, 0.1f, 0.f, 100.f);
+  ImGui::Checkbox("Sleep when invisible", &lod.sleepInvisible);
+  ImGui::InputInt("Budget priority", &lod.priority);
+  auto removedTier = lod.tiers.end();
+  for (auto tier = lod.tiers.begin(); tier != lod.tiers.end(); ++tier) {
+    ImGui::PushID(static_cast<int>(tier - lod.tiers.begin()));
+    std::array values = {tier->distance, tier->amountScale};
+    if (ImGui::DragFloat2("LOD distance/amount", values.data(), 0.01f, 0.f, 100.f)) {
+      *tier = {values[0], std::min(values[1], 1.f)};
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Remove")) {
+      removedTier = tier;
+    }
+    ImGui::PopID();
+  }
+  if (removedTier != lod.tiers.end()) {
+    lod.tiers.erase(removedTier);
+  }
+  if (ImGui::Button("Add LOD tier")) {
+    const auto distance = lod.tiers.empty() ? 5.f : lod.tiers.back().distance * 2.f;
+    lod.tiers.push_back({distance, 0.5f});
+  }
+  if (!mGpuParticleSystem) {
+    const auto& groups = mParticleSystem.particles();
+    const auto group = std::find_if(groups.begin(), groups.end(),
+                                    [this](const auto& element) { return element.spawner == mSpawner; });
+    if (group != groups.end() && group->sleeping) {
+      ImGui::Text("Detail: sleeping");
+    } else if (group != groups.end()) {
+      ImGui::Text("Detail: %.0f%% of the amount", static_cast<double>(group->amountScale) * 100.0);
+    }
+  }
+
   if (ImGui::Button("New")) {
     reset();
   }
@@ -183,21 +326,149 @@ void ParticleEditorState::render()
 
   ImGui::End();
 
-  ImGui::Render();
-  ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  profilerWindow();
+  spawnerCostWindow();
+
+  {
+    ProfileScope profileImGui{&mProfiler, "imgui render"};
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  }
+}
+
+void ParticleEditorState::profilerWindow()
+{
+  ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+  // GPU time lags a few frames behind, simulation stages sum all updates of a frame
+  const auto frames = std::min(mProfiler.frame(), Profiler::historySize);
+  for (const auto& stage : mProfiler.stages()) {
+    auto total = 0.f;
+    auto peak = 0.f;
+    for (std::size_t i = 0; i < frames; i++) {
+      total += stage.seconds[i];
+      peak = std::max(peak, stage.seconds[i]);
+    }
+    if (peak == 0.f) {
+      continue;
+    }
+    const auto average = frames > 0 ? total / static_cast<float>(frames) : 0.f;
+    char overlay[64];
+    std::snprintf(overlay, sizeof(overlay), "avg %.3f ms, max %.3f ms", static_cast<double>(average) * 1000.0,
+                  static_cast<double>(peak) * 1000.0);
+    ImGui::Text("%s", stage.name);
+    ImGui::PushID(stage.name);
+    ImGui::PlotHistogram("##seconds", stage.seconds.data(), static_cast<int>(Profiler::historySize),
+                         static_cast<int>(mProfiler.frame() % Profiler::historySize), overlay, 0.f, peak,
+                         ImVec2(300.f, 40.f));
+    ImGui::PopID();
+  }
+
+  ImGui::Separator();
+  ImGui::Checkbox("Spawner costs", &mShowSpawnerCosts);
+  auto recording = mProfiler.tracing();
+  if (ImGui::Checkbox("Record trace", &recording)) {
+    mProfiler.setTraceFrames(recording ? recordedTraceFrames : 0);
+    mTraceCountdown = 0;
+  }
+  if (recording) {
+    ImGui::SameLine();
+    if (ImGui::Button("Write (F9)")) {
+      writeTrace();
+    }
+    ImGui::Text("%zu frames to %s", mProfiler.tracedFrames(), traceFile);
+  }
+  ImGui::End();
+}
+
+void ParticleEditorState::spawnerCostWindow()
+{
+  // Accounting reads the clock in every spawner job, it only runs while the table is shown
+  if (!mShowSpawnerCosts) {
+    mParticleSystem.setSpawnerCosts(false);
+    return;
+  }
+  const auto expanded = ImGui::Begin("Spawner Costs", &mShowSpawnerCosts, ImGuiWindowFlags_AlwaysAutoResize);
+  mParticleSystem.setSpawnerCosts(expanded && mShowSpawnerCosts && !mGpuParticleSystem);
+  if (!expanded) {
+    ImGui::End();
+    return;
+  }
+  if (mGpuParticleSystem) {
+    ImGui::Text("Only measured for the CPU simulation");
+    ImGui::End();
+    return;
+  }
+  if (ImGui::Button("Reset")) {
+    mParticleSystem.setSpawnerCosts(false);
+    mParticleSystem.setSpawnerCosts(true);
+  }
+
+  // CPU times are averages per update since the reset, the upload is the one of the last frame
+  mCostRows.clear();
+  for (const auto& group : mParticleSystem.particles()) {
+    const auto updates = static_cast<double>(std::max<std::size_t>(group.cost.updates, 1));
+    const auto update = static_cast<double>(group.cost.updateNanoseconds) * 1e-3 / updates;
+    const auto spawn = static_cast<double>(group.cost.spawnNanoseconds) * 1e-3 / updates;
+    mCostRows.push_back({group.spawner,
+                         {update + spawn, update, spawn, static_cast<double>(group.expiry.alive()),
+                          static_cast<double>(mParticleRenderer.uploadedBytes(group.spawner)) / 1024.0,
+                          static_cast<double>(estimatedFillArea(group))}});
+  }
+  std::sort(mCostRows.begin(), mCostRows.end(),
+            [this](const auto& a, const auto& b) { return a.values[mCostSort] > b.values[mCostSort]; });
+
+  constexpr std::array<const char*, costColumns> headers = {"CPU us", "Update us", "Spawn us",
+                                                            "Live",   "Upload KiB", "Fill area"};
+  constexpr std::array<const char*, costColumns> formats = {"%.2f", "%.2f", "%.2f", "%.0f", "%.1f", "%.2f"};
+  ImGui::Columns(static_cast<int>(costColumns) + 1, "costs");
+  ImGui::Text("Spawner");
+  ImGui::NextColumn();
+  // Clicking a header sorts by its column
+  for (std::size_t column = 0; column < costColumns; column++) {
+    if (ImGui::Selectable(headers[column], mCostSort == column)) {
+      mCostSort = column;
+    }
+    ImGui::NextColumn();
+  }
+  ImGui::Separator();
+  for (const auto& row : mCostRows) {
+    const auto entity = static_cast<std::uint32_t>(row.spawner);
+    if (!mWorld.valid(row.spawner)) {
+      ImGui::Text("%u (removed)", entity);
+    } else if (row.spawner == mSpawner && !mCachedSavePath.empty()) {
+      ImGui::Text("%u %s", entity, mCachedSavePath.filename().string().c_str());
+    } else {
+      ImGui::Text("%u", entity);
+    }
+    ImGui::NextColumn();
+    for (std::size_t column = 0; column < costColumns; column++) {
+      ImGui::Text(formats[column], row.values[column]);
+      ImGui::NextColumn();
+    }
+  }
+  ImGui::Columns(1);
+  ImGui::End();
+}
+
+void ParticleEditorState::writeTrace()
+{
+  if (!mProfiler.writeChromeTrace(traceFile)) {
+    APP_ERROR("Could not write the trace to: {}", traceFile);
+  }
 }
 
 void ParticleEditorState::receive(SDL_Event event)
 {
   ImGui_ImplSDL2_ProcessEvent(&event);
+  if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9 && mProfiler.tracing()) {
+    writeTrace();
+  }
 }
 
 std::array<const char*, 1> extensions = {"*.awps"};
 
 void ParticleEditorState::saveSpawner(bool useCachedPath)
 {
-  mDropNextFrame = true;
-
   aw::fs::path path;
   if (!useCachedPath || mCachedSavePath.empty()) {
     const auto pathPtr = tinyfd_saveFileDialog("Save particle spawner", nullptr, extensions.size(), extensions.data(),
@@ -216,11 +487,13 @@ void ParticleEditorState::saveSpawner(bool useCachedPath)
   APP_ERROR("Save to: {}", mCachedSavePath.c_str());
 
   aw::serialize::file(mCachedSavePath, mWorld.get<aw::ParticleSpawner>(mSpawner));
+  if (!saveLod(lodPath(mCachedSavePath), mWorld.get<SpawnerLod>(mSpawner))) {
+    APP_ERROR("Could not save the LOD tiers to: {}", lodPath(mCachedSavePath).c_str());
+  }
 }
 
 void ParticleEditorState::loadSpawner()
 {
-  mDropNextFrame = true;
   reset();
 
   auto pathPtr = tinyfd_openFileDialog("Select particle spawner", nullptr, extensions.size(), extensions.data(),
@@ -233,10 +506,12 @@ void ParticleEditorState::loadSpawner()
   aw::fs::path path = pathPtr;
   auto particleSpawner = aw::parse::file<aw::ParticleSpawner>(path);
   mWorld.replace<aw::ParticleSpawner>(mSpawner, particleSpawner);
+  // Spawners saved without tiers are always simulated at full detail
+  mWorld.replace<SpawnerLod>(mSpawner, loadLod(lodPath(path)).value_or(SpawnerLod{}));
 }
 
 void ParticleEditorState::reset()
 {
-  mDropNextFrame = true;
   mWorld.replace<aw::ParticleSpawner>(mSpawner);
+  mWorld.replace<SpawnerLod>(mSpawner);
 }
@@ -2,17 +2,32 @@
 
 #include "SDL_events.h"
 #include "aw/engine/engine.hpp"
-#include "aw/engine/particleSystem/renderer.hpp"
 #include "aw/engine/particleSystem/spawner.hpp"
-#include "aw/engine/particleSystem/system.hpp"
 #include "aw/engine/state.hpp"
 #include "aw/util/messageBus/subscriber.hpp"
 #include "entt/entity/registry.hpp"
+#include "fixedStepClock.hpp"
+#include "gpuTimer.hpp"
+#include "jobPool.hpp"
+#include "particleSystem/gpuSimulation.hpp"
+#include "particleSystem/renderer.hpp"
+#include "particleSystem/simulation.hpp"
+#include "profiler.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
 
 class ParticleEditorState : public aw::State, public aw::msg::Subscriber<ParticleEditorState, SDL_Event>
 {
 public:
-  ParticleEditorState(aw::Engine& engine);
+  // Writes a trace of the first traceFrames frames to traceFile, 0 does not trace
+  ParticleEditorState(aw::Engine& engine, std::size_t traceFrames = 0);
+
+  // Frames kept by "Record trace", the trace is written with F9 or the profiler window
+  static constexpr std::size_t recordedTraceFrames = 240;
+  static constexpr const char* traceFile = "particleTrace.json";
 
   void update(aw::Seconds dt) override;
   void render() override;
@@ -25,18 +40,43 @@ private:
 
   void reset();
 
+  void profilerWindow();
+  void writeTrace();
+  void spawnerCostWindow();
+
 private:
   aw::Engine& mEngine;
 
   entt::registry mWorld;
 
-  aw::ParticleSystem mParticleSystem;
+  JobPool mJobs;
+
+  ParticleSimulation mParticleSystem;
+  // Replaces mParticleSystem while the GPU compute backend is selected
+  std::unique_ptr<GpuParticleSimulation> mGpuParticleSystem;
 
   entt::entity mSpawner;
 
-  aw::ParticleRenderer mParticleRenderer;
+  ParticleStreamRenderer mParticleRenderer;
+
+  Profiler mProfiler;
+  GpuTimer mParticlePassTimer;
+  // Frames until the --trace-frames trace is written, 0 once it was
+  std::size_t mTraceCountdown{0};
+
+  // Spawner costs are only accounted while their window is shown
+  bool mShowSpawnerCosts{false};
+  // Rows of the spawner cost table, sorted descending by the values of column mCostSort
+  static constexpr std::size_t costColumns = 6;
+  struct CostRow
+  {
+    entt::entity spawner;
+    std::array<double, costColumns> values;
+  };
+  std::vector<CostRow> mCostRows;
+  std::size_t mCostSort{0};
 
-  bool mDropNextFrame{false};
+  FixedStepClock mClock;
 
   aw::fs::path mCachedSavePath{};
 };
@@ -0,0 +1,60 @@
+#include "particleSystem/bounds.hpp"
+
+#include <cmath>
+
+auto burstBounds(const SpawnerSampler& sampler, const aw::Vec3& origin) -> ParticleBounds
+{
+  using Sampler = SpawnerSampler;
+  const auto& p = sampler.particle;
+  const auto ttl = std::max(p[Sampler::Ttl].max(), 0.f);
+  const auto size = std::max(std::abs(p[Sampler::Size].min()), std::abs(p[Sampler::Size].max()));
+  // Quads lie in the xy plane, rotated around their center
+  const auto radius = size * std::sqrt(0.5f);
+
+  ParticleBounds bounds;
+  bounds.min = {origin.x + p[Sampler::PositionX].min() + std::min(p[Sampler::VelocityX].min() * ttl, 0.f) - radius,
+                origin.y + p[Sampler::PositionY].min() + std::min(p[Sampler::VelocityY].min() * ttl, 0.f) - radius,
+                origin.z + p[Sampler::PositionZ].min()};
+  bounds.max = {origin.x + p[Sampler::PositionX].max() + std::max(p[Sampler::VelocityX].max() * ttl, 0.f) + radius,
+                origin.y + p[Sampler::PositionY].max() + std::max(p[Sampler::VelocityY].max() * ttl, 0.f) + radius,
+                origin.z + p[Sampler::PositionZ].max()};
+  bounds.maxSize = size;
+  return bounds;
+}
+
+auto classify(const ParticleBounds& bounds, const CullView& view) -> Visibility
+{
+  if (bounds.empty()) {
+    return Visibility::Outside;
+  }
+
+  // Bit 2k / 2k + 1: the corner is beyond the lower / upper plane of clip axis k
+  unsigned outsideAll = 0x3f;
+  unsigned outsideAny = 0;
+  auto minW = std::numeric_limits<float>::max();
+  for (int corner = 0; corner < 8; corner++) {
+    const aw::Vec4 position{(corner & 1) ? bounds.max.x : bounds.min.x, (corner & 2) ? bounds.max.y : bounds.min.y,
+                            (corner & 4) ? bounds.max.z : bounds.min.z, 1.f};
+    const auto clip = view.clip * position;
+    unsigned outside = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      outside |= clip[axis] < -clip.w ? 1u << (2 * axis) : 0u;
+      outside |= clip[axis] > clip.w ? 2u << (2 * axis) : 0u;
+    }
+    outsideAll &= outside;
+    outsideAny |= outside;
+    minW = std::min(minW, clip.w);
+  }
+  if (outsideAll != 0) {
+    return Visibility::Outside;
+  }
+
+  // Particles get largest at the smallest w, a box reaching behind the camera is never too small
+  if (view.minPixelSize > 0.f && minW > 0.f) {
+    const auto pixels = bounds.maxSize * std::max(view.pixelsPerUnit.x, view.pixelsPerUnit.y) / minW;
+    if (pixels < view.minPixelSize) {
+      return Visibility::Outside;
+    }
+  }
+  return outsideAny == 0 ? Visibility::Inside : Visibility::Intersecting;
+}
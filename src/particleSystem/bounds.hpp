@@ -0,0 +1,52 @@
+#pragma once
+
+#include "aw/util/math/vector.hpp"
+#include "particleSystem/truncatedNormal.hpp"
+
+#include <algorithm>
+#include <limits>
+
+// Axis aligned box around every position the quads of a set of particles cover during their lifetime
+struct ParticleBounds
+{
+  aw::Vec3 min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+               std::numeric_limits<float>::max()};
+  aw::Vec3 max{std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+               std::numeric_limits<float>::lowest()};
+  // Largest spawn size, quads shrink to half of it over their lifetime
+  float maxSize{0.f};
+
+  auto empty() const -> bool { return min.x > max.x; }
+
+  void add(const ParticleBounds& other)
+  {
+    min = {std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)};
+    max = {std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)};
+    maxSize = std::max(maxSize, other.maxSize);
+  }
+};
+
+// Bounds of a burst spawned at origin, derived from the sampled ranges alone: the position offset range, the
+// displacement of the velocity range over the longest ttl and the half diagonal of the largest quad
+auto burstBounds(const SpawnerSampler& sampler, const aw::Vec3& origin) -> ParticleBounds;
+
+enum class Visibility
+{
+  Outside,
+  Intersecting,
+  Inside,
+};
+
+// View a frame is culled against
+struct CullView
+{
+  // Maps world positions to clip space (GL depth range)
+  aw::Mat4 clip;
+  // Pixels covered by one world unit at w = 1 along the screen axes, see particleShading.glsl
+  aw::Vec2 pixelsPerUnit;
+  // Bounds whose largest particle stays below this size in pixels are Outside, 0 disables the test
+  float minPixelSize{0.f};
+};
+
+// Classifies the corners of the bounds against the clip volume
+auto classify(const ParticleBounds& bounds, const CullView& view) -> Visibility;
@@ -0,0 +1,77 @@
+#include "particleSystem/expiryWheel.hpp"
+
+#include <algorithm>
+#include <utility>
+
+auto ExpiryWheel::add(float aliveUntil) -> bool
+{
+  const auto fine = fineBucket(aliveUntil);
+  if (fine < mExpiredBefore) {
+    return false;
+  }
+  while ((fine >> mCoarseness) - mFirst >= static_cast<std::int64_t>(bucketCount)) {
+    coarsen();
+  }
+  count(fine >> mCoarseness)++;
+  mAlive++;
+  return true;
+}
+
+auto ExpiryWheel::remove(float aliveUntil) -> bool
+{
+  const auto fine = fineBucket(aliveUntil);
+  if (fine < mExpiredBefore || mAlive == 0) {
+    return false;
+  }
+  const auto b = fine >> mCoarseness;
+  if (b - mFirst >= static_cast<std::int64_t>(bucketCount) || count(b) == 0) {
+    return false;
+  }
+  count(b)--;
+  mAlive--;
+  if (mAlive == 0) {
+    refine();
+  }
+  return true;
+}
+
+auto ExpiryWheel::expire(float time) -> std::size_t
+{
+  const auto end = fineBucket(time) >> mCoarseness;
+  if (end <= mFirst) {
+    return 0;
+  }
+
+  // Buckets beyond the wheel are empty
+  std::size_t expired = 0;
+  const auto last = std::min(end, mFirst + static_cast<std::int64_t>(bucketCount));
+  for (auto b = mFirst; b < last && expired < mAlive; b++) {
+    expired += std::exchange(count(b), 0);
+  }
+  mFirst = end;
+  mExpiredBefore = std::max(mExpiredBefore, end << mCoarseness);
+  mAlive -= expired;
+  if (mAlive == 0) {
+    refine();
+  }
+  return expired;
+}
+
+void ExpiryWheel::coarsen()
+{
+  // Bucket b becomes bucket b / 2 of the wider buckets, the wheel keeps covering the buckets it covered
+  std::array<std::uint32_t, bucketCount> merged{};
+  for (auto b = mFirst; b < mFirst + static_cast<std::int64_t>(bucketCount); b++) {
+    merged[static_cast<std::size_t>(b >> 1) % bucketCount] += count(b);
+  }
+  mCounts = merged;
+  mFirst >>= 1;
+  mCoarseness++;
+}
+
+void ExpiryWheel::refine()
+{
+  // Every bucket is empty
+  mFirst = mExpiredBefore;
+  mCoarseness = 0;
+}
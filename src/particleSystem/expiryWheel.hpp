@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Alive particles of one spawner group, counted by the time they expire. The ring of a group retires only from its
+// tail, its resident particles include expired ones behind a longer living particle. The wheel counts a particle as
+// expired once its bucket ended, at most bucketSeconds() after its aliveUntil. Adding and removing a particle is O(1),
+// expiring costs O(buckets ended).
+//
+// The wheel has a fixed number of buckets and never touches the heap. Buckets start minBucketSeconds wide, a particle
+// expiring beyond the last bucket doubles their width by merging neighbouring buckets until it fits. The width only
+// drops back to minBucketSeconds once no particle is counted.
+class ExpiryWheel
+{
+public:
+  static constexpr std::size_t bucketCount = 512;
+  static constexpr float minBucketSeconds = 1.f / 240.f;
+
+  auto alive() const -> std::size_t { return mAlive; }
+  auto bucketSeconds() const -> float { return minBucketSeconds * static_cast<float>(std::int64_t{1} << mCoarseness); }
+
+  // Returns false if the particle's bucket already ended, it is not counted then
+  auto add(float aliveUntil) -> bool;
+  // Uncounts a particle dropped before its expiry, returns false if it was expired already
+  auto remove(float aliveUntil) -> bool;
+  // Drops the buckets ended by time, returns the particles they held
+  auto expire(float time) -> std::size_t;
+
+private:
+  // Index of the minBucketSeconds wide bucket holding time
+  static auto fineBucket(float time) -> std::int64_t
+  {
+    return static_cast<std::int64_t>(std::floor(time / minBucketSeconds));
+  }
+  auto count(std::int64_t bucket) -> std::uint32_t& { return mCounts[static_cast<std::size_t>(bucket) % bucketCount]; }
+  // Doubles the bucket width
+  void coarsen();
+  // Back to minBucketSeconds wide buckets once no particle is counted
+  void refine();
+
+  // Buckets [mFirst, mFirst + bucketCount) at the current width, circular
+  std::array<std::uint32_t, bucketCount> mCounts{};
+  std::int64_t mFirst{0};
+  // Bucket width is minBucketSeconds << mCoarseness
+  int mCoarseness{0};
+  // Fine bucket before which every particle expired. A merged first bucket may start before it.
+  std::int64_t mExpiredBefore{0};
+  std::size_t mAlive{0};
+};
@@ -0,0 +1,411 @@
+#include "particleSystem/gpuSimulation.hpp"
+
+#include "aw/util/math/transform.hpp"
+#include "glExt.hpp"
+#include "particleSystem/shader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+constexpr std::size_t minCapacity = 64;
+
+// Work group sizes of the compute shaders
+constexpr GLuint spawnGroupSize = 64;
+constexpr GLuint relocateGroupSize = 256;
+// Smallest GL_MAX_COMPUTE_WORK_GROUP_COUNT the spec allows
+constexpr GLuint maxWorkGroups = 65535;
+
+// Shader storage bindings, see particleCompute.glsl
+constexpr GLuint groupsBinding = 5;
+constexpr GLuint tailsBinding = 6;
+constexpr GLuint drawCommandsBinding = 7;
+constexpr GLuint batchesBinding = 8;
+constexpr GLuint quantilesBinding = 9;
+constexpr GLuint previousStreamsBinding = 10;
+constexpr GLuint previousTailsBinding = 15;
+
+constexpr std::size_t tailSize = 2 * sizeof(std::uint32_t);
+constexpr std::size_t drawCommandSize = 4 * sizeof(std::uint32_t);
+
+constexpr auto streamSizes = instanceStreamSizes(InstanceFormat::Float);
+
+// Largest ttl the sampler returns, the margin covers the rounding of the table interpolation
+auto upperTtl(const TruncatedNormal& ttl) -> float
+{
+  return ttl.max() + (std::abs(ttl.min()) + std::abs(ttl.max())) * 1e-6f;
+}
+
+auto createBuffer(std::size_t size, const void* data, GLenum usage) -> GLuint
+{
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(size), data, usage);
+  return buffer;
+}
+
+// Orphans the buffer and uploads data
+template <typename T>
+auto upload(GLuint buffer, const std::vector<T>& data) -> std::size_t
+{
+  const auto size = data.size() * sizeof(T);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max(size, sizeof(T))), data.data(),
+               GL_STREAM_DRAW);
+  return size;
+}
+
+auto split(std::uint64_t sequence) -> std::array<std::uint32_t, 2>
+{
+  return {static_cast<std::uint32_t>(sequence), static_cast<std::uint32_t>(sequence >> 32)};
+}
+} // namespace
+
+GpuParticleSimulation::GpuParticleSimulation(entt::registry& world, const aw::fs::path& shaderDirectory,
+                                             std::uint32_t seed) :
+    mWorld{world}, mSeed{seed}
+{
+  const auto common = shaderDirectory / "particleCompute.glsl";
+
+  mSpawnProgram.id = loadComputeProgram({common, shaderDirectory / "particleSpawn.comp"});
+  mSpawnProgram.simulationSeed = glGetUniformLocation(mSpawnProgram.id, "simulationSeed");
+  mSpawnProgram.batchCount = glGetUniformLocation(mSpawnProgram.id, "batchCount");
+  mSpawnProgram.particleCount = glGetUniformLocation(mSpawnProgram.id, "particleCount");
+  mSpawnProgram.firstInvocation = glGetUniformLocation(mSpawnProgram.id, "firstInvocation");
+
+  mRetireProgram.id = loadComputeProgram({common, shaderDirectory / "particleRetire.comp"});
+  mRetireProgram.simulationTime = glGetUniformLocation(mRetireProgram.id, "simulationTime");
+
+  mRelocateProgram.id = loadComputeProgram({common, shaderDirectory / "particleRelocate.comp"});
+  mRelocateProgram.previousGroup = glGetUniformLocation(mRelocateProgram.id, "previousGroup");
+  mRelocateProgram.previousBase = glGetUniformLocation(mRelocateProgram.id, "previousBase");
+  mRelocateProgram.previousMask = glGetUniformLocation(mRelocateProgram.id, "previousMask");
+  mRelocateProgram.group = glGetUniformLocation(mRelocateProgram.id, "group");
+  mRelocateProgram.base = glGetUniformLocation(mRelocateProgram.id, "base");
+  mRelocateProgram.mask = glGetUniformLocation(mRelocateProgram.id, "mask");
+  mRelocateProgram.head = glGetUniformLocation(mRelocateProgram.id, "head");
+
+  const auto& quantiles = TruncatedNormal::quantiles();
+  mQuantiles = createBuffer(sizeof(quantiles), quantiles.data(), GL_STATIC_DRAW);
+  mGroupBuffer = createBuffer(sizeof(GroupParameters), nullptr, GL_STREAM_DRAW);
+  mBatchBuffer = createBuffer(sizeof(Batch), nullptr, GL_STREAM_DRAW);
+}
+
+GpuParticleSimulation::~GpuParticleSimulation()
+{
+  if (mStreams[0] != 0) {
+    glDeleteBuffers(static_cast<GLsizei>(maxInstanceStreams), mStreams.data());
+  }
+  for (auto buffer : {mTails, mDrawCommands, mGroupBuffer, mBatchBuffer, mQuantiles}) {
+    glDeleteBuffers(1, &buffer);
+  }
+  for (auto program : {mSpawnProgram.id, mRetireProgram.id, mRelocateProgram.id}) {
+    glDeleteProgram(program);
+  }
+}
+
+auto GpuParticleSimulation::supported() -> bool
+{
+  return glExt::hasComputeShader();
+}
+
+auto GpuParticleSimulation::valid() const -> bool
+{
+  return mSpawnProgram.id != 0 && mRetireProgram.id != 0 && mRelocateProgram.id != 0;
+}
+
+auto GpuParticleSimulation::residentBound() const -> std::size_t
+{
+  return std::accumulate(mGroups.begin(), mGroups.end(), std::size_t{0},
+                         [](auto sum, const auto& group) { return sum + group.residentBound; });
+}
+
+void GpuParticleSimulation::update(aw::Seconds dt)
+{
+  if (!valid()) {
+    return;
+  }
+  mSimulationTime += dt.count();
+  mBatches.clear();
+  mSpawnedParticles = 0;
+
+  // Bursts are scheduled exactly like ParticleSimulation::schedule, only the particles are sampled on the GPU
+  std::vector<bool> touched(mGroups.size(), false);
+  auto view = mWorld.view<aw::Transform, aw::ParticleSpawner>();
+  for (auto entity : view) {
+    const auto origin = view.get<aw::Transform>(entity).position();
+    const auto index = group(entity, origin);
+    touched.resize(mGroups.size(), false);
+    touched[index] = true;
+
+    auto& group = mGroups[index];
+    const auto& spawner = view.get<aw::ParticleSpawner>(entity);
+    const auto previousOrigin = group.origin;
+    group.origin = origin;
+    group.colorGradient = spawner.colorGradient;
+    group.fadeIn = spawner.fadeIn;
+    group.sampler.update(spawner);
+    expire(group);
+    group.retireEnd = group.head;
+
+    const philox::Key key{static_cast<std::uint32_t>(entity), mSeed};
+    const auto expires = mSimulationTime + upperTtl(group.sampler.particle[SpawnerSampler::Ttl]);
+    group.schedule.advance(group.sampler, key, dt.count(), [&](std::size_t count, float late) {
+      const auto burst = burstOrigin(previousOrigin, origin, late, dt.count());
+      const auto bounds = burstBounds(group.sampler, burst);
+      mBatches.push_back({static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(mSpawnedParticles),
+                          split(group.head),
+                          {burst.x, burst.y, burst.z, mSimulationTime - late}});
+      mSpawnedParticles += count;
+      group.head += count;
+      group.bursts.push_back({expires, count, bounds});
+      group.residentBound += count;
+      group.bounds.add(bounds);
+    });
+  }
+
+  // Groups of removed spawners are kept until every particle expired
+  for (std::size_t i = 0; i < mGroups.size(); i++) {
+    auto& group = mGroups[i];
+    if (touched[i] || group.spawner == entt::null) {
+      continue;
+    }
+    expire(group);
+    group.retireEnd = group.head;
+    if (group.bursts.empty()) {
+      mGroupIndices.erase(group.spawner);
+      group.spawner = entt::null;
+      mRemovedGroups++;
+    }
+  }
+
+  if (needsRelayout()) {
+    relayout();
+  }
+  uploadGroups();
+  retire();
+  // New particles may reuse the slots of particles the retire pass is still checking
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  spawn();
+
+  // Next passes read the pool and tails, the renderer reads the streams and draw commands
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+auto GpuParticleSimulation::readBack(entt::entity spawner) const -> ParticleStreams
+{
+  ParticleStreams streams;
+  auto it = mGroupIndices.find(spawner);
+  if (it == mGroupIndices.end()) {
+    return streams;
+  }
+  const auto index = it->second;
+  const auto& group = mGroups[index];
+
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  std::array<std::uint32_t, 2> tail{};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mTails);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(index * tailSize), tailSize, tail.data());
+  streams.reserve(group.capacity);
+  streams.tail = (static_cast<std::uint64_t>(tail[1]) << 32) | tail[0];
+  streams.head = group.head;
+
+  const std::array<void*, maxInstanceStreams> out = {streams.positionSize.data(), streams.velocity.data(),
+                                                      streams.rotation.data(), streams.aliveUntil.data(),
+                                                      streams.aliveFor.data()};
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mStreams[s]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(group.base * streamSizes[s]),
+                       static_cast<GLsizeiptr>(group.capacity * streamSizes[s]), out[s]);
+  }
+  return streams;
+}
+
+auto GpuParticleSimulation::group(entt::entity spawner, const aw::Vec3& origin) -> std::size_t
+{
+  auto it = mGroupIndices.find(spawner);
+  if (it != mGroupIndices.end()) {
+    return it->second;
+  }
+  const auto index = mGroups.size();
+  mGroupIndices.emplace(spawner, index);
+  auto& group = mGroups.emplace_back();
+  group.spawner = spawner;
+  group.origin = origin;
+  // The tails and draw commands have no entry for the group yet
+  mGroupAdded = true;
+  return index;
+}
+
+void GpuParticleSimulation::expire(Group& group)
+{
+  // Retiring stops at the first alive particle, so only whole bursts from the front count as gone
+  const auto bursts = group.bursts.size();
+  while (!group.bursts.empty() && group.bursts.front().expires <= mSimulationTime) {
+    group.residentBound -= group.bursts.front().count;
+    group.bursts.pop_front();
+  }
+  if (group.bursts.size() != bursts) {
+    group.bounds = {};
+    for (const auto& burst : group.bursts) {
+      group.bounds.add(burst.bounds);
+    }
+  }
+}
+
+auto GpuParticleSimulation::needsRelayout() const -> bool
+{
+  if (mGroupAdded || mRemovedGroups > mGroups.size() / 2) {
+    return true;
+  }
+  return std::any_of(mGroups.begin(), mGroups.end(),
+                     [](const auto& group) { return group.residentBound > group.capacity; });
+}
+
+void GpuParticleSimulation::relayout()
+{
+  struct Relocation
+  {
+    GLuint previousGroup;
+    std::size_t previousBase;
+    std::size_t previousCapacity;
+  };
+
+  // Removed groups are dropped, every ring gets the capacity for its resident bound
+  std::vector<Group> groups;
+  std::vector<Relocation> relocations;
+  std::vector<std::uint32_t> indices(mGroups.size(), 0);
+  std::size_t poolCapacity = 0;
+  for (std::size_t i = 0; i < mGroups.size(); i++) {
+    if (mGroups[i].spawner == entt::null) {
+      continue;
+    }
+    indices[i] = static_cast<std::uint32_t>(groups.size());
+    relocations.push_back({static_cast<GLuint>(i), mGroups[i].base, mGroups[i].capacity});
+    auto& group = groups.emplace_back(std::move(mGroups[i]));
+    auto capacity = std::max(group.capacity, minCapacity);
+    while (capacity < group.residentBound) {
+      capacity *= 2;
+    }
+    group.base = poolCapacity;
+    group.capacity = capacity;
+    poolCapacity += capacity;
+  }
+
+  std::array<GLuint, maxInstanceStreams> streams{};
+  glGenBuffers(static_cast<GLsizei>(maxInstanceStreams), streams.data());
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    const auto size = std::max(poolCapacity, minCapacity) * streamSizes[s];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, streams[s]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_COPY);
+  }
+  // Tails of new groups start at sequence 0
+  const std::vector<std::uint32_t> zeros(std::max<std::size_t>(groups.size(), 1) * 2, 0);
+  const auto tails = createBuffer(zeros.size() * sizeof(std::uint32_t), zeros.data(), GL_DYNAMIC_COPY);
+
+  glUseProgram(mRelocateProgram.id);
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(s), streams[s]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, previousStreamsBinding + static_cast<GLuint>(s), mStreams[s]);
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, tailsBinding, tails);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, previousTailsBinding, mTails);
+  for (std::size_t i = 0; i < groups.size(); i++) {
+    const auto& relocation = relocations[i];
+    // Groups added by this update have no particles on the GPU yet
+    if (relocation.previousCapacity == 0) {
+      continue;
+    }
+    const auto& group = groups[i];
+    glUniform1ui(mRelocateProgram.previousGroup, relocation.previousGroup);
+    glUniform1ui(mRelocateProgram.previousBase, static_cast<GLuint>(relocation.previousBase));
+    glUniform1ui(mRelocateProgram.previousMask, static_cast<GLuint>(relocation.previousCapacity - 1));
+    glUniform1ui(mRelocateProgram.group, static_cast<GLuint>(i));
+    glUniform1ui(mRelocateProgram.base, static_cast<GLuint>(group.base));
+    glUniform1ui(mRelocateProgram.mask, static_cast<GLuint>(group.capacity - 1));
+    glUniform1ui(mRelocateProgram.head, static_cast<GLuint>(group.retireEnd));
+    const auto workGroups = (relocation.previousCapacity + relocateGroupSize - 1) / relocateGroupSize;
+    glExt::dispatchCompute(static_cast<GLuint>(workGroups), 1, 1);
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  if (mStreams[0] != 0) {
+    glDeleteBuffers(static_cast<GLsizei>(maxInstanceStreams), mStreams.data());
+  }
+  glDeleteBuffers(1, &mTails);
+  glDeleteBuffers(1, &mDrawCommands);
+  mStreams = streams;
+  mTails = tails;
+  mPoolCapacity = poolCapacity;
+  mDrawCommands = createBuffer(std::max<std::size_t>(groups.size(), 1) * drawsPerGroup * drawCommandSize, nullptr,
+                               GL_DYNAMIC_COPY);
+
+  for (auto& batch : mBatches) {
+    batch.group = indices[batch.group];
+  }
+  mGroups = std::move(groups);
+  mGroupIndices.clear();
+  for (std::size_t i = 0; i < mGroups.size(); i++) {
+    mGroupIndices.emplace(mGroups[i].spawner, i);
+  }
+  mRemovedGroups = 0;
+  mGroupAdded = false;
+}
+
+void GpuParticleSimulation::uploadGroups()
+{
+  mGroupParameters.clear();
+  for (const auto& group : mGroups) {
+    auto& parameters = mGroupParameters.emplace_back();
+    parameters.base = static_cast<std::uint32_t>(group.base);
+    parameters.mask = static_cast<std::uint32_t>(group.capacity - 1);
+    parameters.spawner = static_cast<std::uint32_t>(group.spawner);
+    parameters.padding = 0;
+    parameters.retireEnd = split(group.retireEnd);
+    parameters.head = split(group.head);
+    for (std::size_t p = 0; p < SpawnerSampler::ParticlePropertyCount; p++) {
+      parameters.mid[p] = group.sampler.particle[p].mid();
+      parameters.halfRange[p] = group.sampler.particle[p].halfRange();
+    }
+  }
+  mUploadedBytes = upload(mGroupBuffer, mGroupParameters);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, groupsBinding, mGroupBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, tailsBinding, mTails);
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(s), mStreams[s]);
+  }
+}
+
+void GpuParticleSimulation::retire()
+{
+  if (mGroups.empty()) {
+    return;
+  }
+  glUseProgram(mRetireProgram.id);
+  glUniform1f(mRetireProgram.simulationTime, mSimulationTime);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, drawCommandsBinding, mDrawCommands);
+  glExt::dispatchCompute(static_cast<GLuint>(mGroups.size()), 1, 1);
+}
+
+void GpuParticleSimulation::spawn()
+{
+  if (mSpawnedParticles == 0) {
+    return;
+  }
+  mUploadedBytes += upload(mBatchBuffer, mBatches);
+
+  glUseProgram(mSpawnProgram.id);
+  glUniform1ui(mSpawnProgram.simulationSeed, mSeed);
+  glUniform1ui(mSpawnProgram.batchCount, static_cast<GLuint>(mBatches.size()));
+  glUniform1ui(mSpawnProgram.particleCount, static_cast<GLuint>(mSpawnedParticles));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, batchesBinding, mBatchBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, quantilesBinding, mQuantiles);
+
+  const auto workGroups = (mSpawnedParticles + spawnGroupSize - 1) / spawnGroupSize;
+  for (std::size_t first = 0; first < workGroups; first += maxWorkGroups) {
+    glUniform1ui(mSpawnProgram.firstInvocation, static_cast<GLuint>(first * spawnGroupSize));
+    glExt::dispatchCompute(static_cast<GLuint>(std::min<std::size_t>(workGroups - first, maxWorkGroups)), 1, 1);
+  }
+}
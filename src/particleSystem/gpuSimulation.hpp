@@ -0,0 +1,193 @@
+#pragma once
+
+#include "aw/engine/particleSystem/spawner.hpp"
+#include "aw/graphics/opengl/gl.hpp"
+#include "aw/util/filesystem/fileStream.hpp"
+#include "aw/util/math/vector.hpp"
+#include "aw/util/time/time.hpp"
+#include "entt/entity/registry.hpp"
+#include "particleSystem/bounds.hpp"
+#include "particleSystem/instanceFormat.hpp"
+#include "particleSystem/spawnSchedule.hpp"
+#include "particleSystem/streams.hpp"
+#include "particleSystem/truncatedNormal.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// Compute shader backend of ParticleSimulation (GL 4.3). Spawning and expiry run in shader storage buffers and the
+// renderer draws straight from them through indirect draws written on the GPU, nothing is read back.
+//
+// Every spawner owns a ring of slots in one pool buffer per InstanceFormat::Float stream, with the slot layout of
+// ParticleStreams. Bursts are still scheduled on the CPU with the same SpawnSchedule, the spawn pass then samples every
+// particle from the same philox words and TruncatedNormal table as ParticleSimulation::fill, so for the same seed both
+// backends hold bit identical particles (see readBack). The retire pass advances the ring tails like kernels::retire.
+//
+// The CPU never learns the GPU tails. A ring is sized for the particles spawned within the largest possible ttl
+// instead, an upper bound of its resident particles, and grows by relocating the pool on the GPU.
+class GpuParticleSimulation
+{
+public:
+  // Indirect draws per group in drawCommands(), the ring ranges before and after the wrap
+  static constexpr std::size_t drawsPerGroup = 2;
+
+  struct Group
+  {
+    // entt::null once the spawner was removed and all of its particles expired, dropped on the next relayout
+    entt::entity spawner{entt::null};
+
+    // Render state copied from the spawner component on every update
+    decltype(aw::ParticleSpawner::colorGradient) colorGradient{};
+    float fadeIn{0.f};
+    // Spawner position of the last update, bursts are spawned along the way from it like in ParticleSimulation
+    aw::Vec3 origin{0.f, 0.f, 0.f};
+
+    SpawnerSampler sampler;
+    SpawnSchedule schedule;
+
+    // Slots [base, base + capacity) of the pool, capacity is a power of two
+    std::size_t base{0};
+    std::size_t capacity{0};
+    std::uint64_t head{0};
+    // Head before the bursts of the current update
+    std::uint64_t retireEnd{0};
+
+    // Bursts which may still have alive particles, in spawn order
+    struct Burst
+    {
+      float expires;
+      std::size_t count;
+      ParticleBounds bounds;
+    };
+    std::deque<Burst> bursts;
+    // Sum of the burst counts, upper bound of the resident particles
+    std::size_t residentBound{0};
+    // Union of the burst bounds, for culling
+    ParticleBounds bounds;
+  };
+
+  GpuParticleSimulation(entt::registry& world, const aw::fs::path& shaderDirectory, std::uint32_t seed = 0);
+  ~GpuParticleSimulation();
+
+  GpuParticleSimulation(const GpuParticleSimulation&) = delete;
+  auto operator=(const GpuParticleSimulation&) -> GpuParticleSimulation& = delete;
+
+  // Requires a current GL 4.3 context
+  static auto supported() -> bool;
+  // False if a compute program failed to compile
+  auto valid() const -> bool;
+
+  void update(aw::Seconds dt);
+
+  auto seed() const -> std::uint32_t { return mSeed; }
+  auto simulationTime() const -> float { return mSimulationTime; }
+  auto groups() const -> const std::vector<Group>& { return mGroups; }
+  // Sum of the resident upper bounds, the exact count only exists on the GPU
+  auto residentBound() const -> std::size_t;
+  // Bytes uploaded by the last update (group parameters and bursts)
+  auto uploadedBytes() const -> std::size_t { return mUploadedBytes; }
+
+  // Pool buffers in InstanceFormat::Float stream order, instance i of a draw command is pool slot i
+  auto streams() const -> const std::array<GLuint, maxInstanceStreams>& { return mStreams; }
+  // Slots of the pool in use, the rings of all groups
+  auto poolCapacity() const -> std::size_t { return mPoolCapacity; }
+  // DrawArraysIndirectCommand[groups().size() * drawsPerGroup] of the resident particles
+  auto drawCommands() const -> GLuint { return mDrawCommands; }
+
+  // Copies the resident particles of a spawner back into CPU streams (empty if it has no group). Stalls the pipeline,
+  // only meant for verifying the backend against ParticleSimulation.
+  auto readBack(entt::entity spawner) const -> ParticleStreams;
+
+private:
+  struct SpawnProgram
+  {
+    GLuint id{0};
+    GLint simulationSeed{-1};
+    GLint batchCount{-1};
+    GLint particleCount{-1};
+    GLint firstInvocation{-1};
+  };
+
+  struct RetireProgram
+  {
+    GLuint id{0};
+    GLint simulationTime{-1};
+  };
+
+  struct RelocateProgram
+  {
+    GLuint id{0};
+    GLint previousGroup{-1};
+    GLint previousBase{-1};
+    GLint previousMask{-1};
+    GLint group{-1};
+    GLint base{-1};
+    GLint mask{-1};
+    GLint head{-1};
+  };
+
+  auto group(entt::entity spawner, const aw::Vec3& origin) -> std::size_t;
+  void expire(Group& group);
+
+  auto needsRelayout() const -> bool;
+  void relayout();
+
+  void uploadGroups();
+  void retire();
+  void spawn();
+
+private:
+  entt::registry& mWorld;
+  std::uint32_t mSeed;
+
+  float mSimulationTime{0.f};
+
+  std::vector<Group> mGroups;
+  std::unordered_map<entt::entity, std::size_t> mGroupIndices;
+  std::size_t mRemovedGroups{0};
+  bool mGroupAdded{false};
+
+  // Mirrors of the std430 structs in particleCompute.glsl and particleSpawn.comp
+  struct GroupParameters
+  {
+    std::uint32_t base;
+    std::uint32_t mask;
+    std::uint32_t spawner;
+    std::uint32_t padding;
+    std::array<std::uint32_t, 2> retireEnd;
+    std::array<std::uint32_t, 2> head;
+    std::array<float, SpawnerSampler::ParticlePropertyCount> mid;
+    std::array<float, SpawnerSampler::ParticlePropertyCount> halfRange;
+  };
+  static_assert(sizeof(GroupParameters) == 96);
+
+  struct Batch
+  {
+    std::uint32_t group;
+    std::uint32_t offset;
+    std::array<std::uint32_t, 2> first;
+    std::array<float, 4> originTime;
+  };
+  static_assert(sizeof(Batch) == 32);
+
+  std::vector<GroupParameters> mGroupParameters;
+  std::vector<Batch> mBatches;
+  std::size_t mSpawnedParticles{0};
+  std::size_t mUploadedBytes{0};
+
+  SpawnProgram mSpawnProgram;
+  RetireProgram mRetireProgram;
+  RelocateProgram mRelocateProgram;
+
+  std::array<GLuint, maxInstanceStreams> mStreams{};
+  std::size_t mPoolCapacity{0};
+  GLuint mTails{0};
+  GLuint mDrawCommands{0};
+  GLuint mGroupBuffer{0};
+  GLuint mBatchBuffer{0};
+  GLuint mQuantiles{0};
+};
@@ -0,0 +1,167 @@
+#include "particleSystem/instanceFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+struct CompactInstance
+{
+  std::array<std::uint16_t, 4> offsetSize;
+  std::array<std::uint16_t, 2> velocity;
+  std::array<std::uint16_t, 2> rotationAliveFor;
+  float aliveUntil;
+};
+
+auto encode(const ParticleStreams& streams, std::size_t i, const aw::Vec3& anchor) -> CompactInstance
+{
+  const auto& p = streams.positionSize[i];
+  return {{toHalf(p.x - anchor.x), toHalf(p.y - anchor.y), toHalf(p.z - anchor.z), toHalf(p.w)},
+          {toHalf(streams.velocity[i].x), toHalf(streams.velocity[i].y)},
+          {toHalf(streams.rotation[i]), toHalf(streams.aliveFor[i])},
+          streams.aliveUntil[i]};
+}
+
+template <typename T>
+void copyRanges(const ParticleStream<T>& stream, const std::array<ParticleStreams::SlotRange, 2>& ranges,
+                unsigned char* out)
+{
+  for (const auto& range : ranges) {
+    std::memcpy(out, stream.data() + range.first, range.count * sizeof(T));
+    out += range.count * sizeof(T);
+  }
+}
+} // namespace
+
+auto toHalf(float value) -> std::uint16_t
+{
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+  bits &= 0x7fffffffu;
+
+  if (bits >= 0x7f800000u) {
+    // Infinity stays infinity, NaN stays a quiet NaN
+    return sign | 0x7c00u | (bits > 0x7f800000u ? 0x0200u : 0u);
+  }
+  if (bits >= 0x477ff000u) {
+    // Rounds to 65520 or more
+    return sign | 0x7c00u;
+  }
+  if (bits < 0x38800000u) {
+    // Below the smallest normal half 2^-14, the result is subnormal or zero
+    if (bits < 0x33000000u) {
+      return sign;
+    }
+    const auto exponent = bits >> 23;
+    const auto mantissa = (bits & 0x7fffffu) | 0x800000u;
+    const auto shift = 126 - exponent;
+    auto half = mantissa >> shift;
+    const auto remainder = mantissa & ((1u << shift) - 1);
+    const auto halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+      half++;
+    }
+    return sign | static_cast<std::uint16_t>(half);
+  }
+
+  // Rebias the exponent from 127 to 15, a mantissa carry correctly bumps the exponent
+  auto half = (bits - 0x38000000u) >> 13;
+  const auto remainder = bits & 0x1fffu;
+  if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+    half++;
+  }
+  return sign | static_cast<std::uint16_t>(half);
+}
+
+auto fromHalf(std::uint16_t half) -> float
+{
+  const auto sign = static_cast<std::uint32_t>(half & 0x8000u) << 16;
+  const auto exponent = (half >> 10) & 0x1fu;
+  const auto mantissa = static_cast<std::uint32_t>(half & 0x3ffu);
+
+  if (exponent == 0) {
+    const auto value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  }
+  std::uint32_t bits;
+  if (exponent == 31) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void writeInstances(InstanceFormat format, const ParticleStreams& streams, std::uint64_t from, std::uint64_t to,
+                    const aw::Vec3& anchor, const std::array<unsigned char*, maxInstanceStreams>& out)
+{
+  const auto ranges = streams.ranges(from, to);
+  if (format == InstanceFormat::Float) {
+    copyRanges(streams.positionSize, ranges, out[0]);
+    copyRanges(streams.velocity, ranges, out[1]);
+    copyRanges(streams.rotation, ranges, out[2]);
+    copyRanges(streams.aliveUntil, ranges, out[3]);
+    copyRanges(streams.aliveFor, ranges, out[4]);
+    return;
+  }
+
+  auto* offsetSize = reinterpret_cast<std::array<std::uint16_t, 4>*>(out[0]);
+  auto* velocity = reinterpret_cast<std::array<std::uint16_t, 2>*>(out[1]);
+  auto* rotationAliveFor = reinterpret_cast<std::array<std::uint16_t, 2>*>(out[2]);
+  auto* aliveUntil = reinterpret_cast<float*>(out[3]);
+  std::size_t n = 0;
+  for (const auto& range : ranges) {
+    for (auto i = range.first; i < range.first + range.count; i++, n++) {
+      const auto instance = encode(streams, i, anchor);
+      offsetSize[n] = instance.offsetSize;
+      velocity[n] = instance.velocity;
+      rotationAliveFor[n] = instance.rotationAliveFor;
+      aliveUntil[n] = instance.aliveUntil;
+    }
+  }
+}
+
+auto measureCompactError(const std::vector<SpawnerParticles>& particles, float time) -> CompactError
+{
+  CompactError error;
+  double positionSum = 0.0;
+  for (const auto& group : particles) {
+    const auto& streams = group.streams;
+    for (auto sequence = streams.tail; sequence < streams.head; sequence++) {
+      const auto i = streams.slot(sequence);
+      const auto instance = encode(streams, i, group.origin);
+
+      // Same evaluation as particle.vert for both formats
+      const auto& p = streams.positionSize[i];
+      const auto& v = streams.velocity[i];
+      const auto age = time - (streams.aliveUntil[i] - streams.aliveFor[i]);
+      const aw::Vec2 position{p.x + v.x * age, p.y + v.y * age};
+
+      const aw::Vec3 origin{group.origin.x + fromHalf(instance.offsetSize[0]),
+                            group.origin.y + fromHalf(instance.offsetSize[1]),
+                            group.origin.z + fromHalf(instance.offsetSize[2])};
+      const aw::Vec2 velocity{fromHalf(instance.velocity[0]), fromHalf(instance.velocity[1])};
+      const auto lifetime = fromHalf(instance.rotationAliveFor[1]);
+      const auto compactAge = time - (instance.aliveUntil - lifetime);
+      const aw::Vec2 compactPosition{origin.x + velocity.x * compactAge, origin.y + velocity.y * compactAge};
+
+      const auto positionError = std::hypot(static_cast<double>(position.x - compactPosition.x),
+                                            static_cast<double>(position.y - compactPosition.y),
+                                            static_cast<double>(p.z - origin.z));
+      error.positionMax = std::max(error.positionMax, positionError);
+      positionSum += positionError;
+      error.velocityMax = std::max(
+          error.velocityMax, std::hypot(static_cast<double>(v.x - velocity.x), static_cast<double>(v.y - velocity.y)));
+      error.sizeMax = std::max(error.sizeMax, std::abs(static_cast<double>(p.w - fromHalf(instance.offsetSize[3]))));
+      const auto rotation = fromHalf(instance.rotationAliveFor[0]);
+      error.rotationMax = std::max(error.rotationMax, std::abs(static_cast<double>(streams.rotation[i] - rotation)));
+      error.lifetimeMax = std::max(error.lifetimeMax, std::abs(static_cast<double>(streams.aliveFor[i] - lifetime)));
+      error.particles++;
+    }
+  }
+  error.positionMean = error.particles > 0 ? positionSum / static_cast<double>(error.particles) : 0.0;
+  return error;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "aw/util/math/vector.hpp"
+#include "particleSystem/simulation.hpp"
+#include "particleSystem/streams.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Memory layout of the per instance attributes read by particle.vert, every attribute is its own stream.
+//
+// Float (36 bytes): positionSize vec4, velocity vec2, rotation, aliveUntil, aliveFor as 32 bit floats.
+// Compact (20 bytes, particle.vert with COMPACT_INSTANCES): half floats for the position relative to a per spawner
+// anchor and the size, the velocity, the rotation and the lifetime. aliveUntil stays a 32 bit float, it is an absolute
+// simulation time and half floats lose whole frames after a few seconds.
+enum class InstanceFormat
+{
+  Float,
+  Compact,
+};
+
+inline auto instanceFormatName(InstanceFormat format) -> const char*
+{
+  return format == InstanceFormat::Float ? "float" : "compact";
+}
+
+constexpr std::size_t maxInstanceStreams = 5;
+
+// Bytes per instance of every stream, unused streams are 0
+constexpr auto instanceStreamSizes(InstanceFormat format) -> std::array<std::size_t, maxInstanceStreams>
+{
+  if (format == InstanceFormat::Float) {
+    return {16, 8, 4, 4, 4};
+  }
+  return {8, 4, 4, 4, 0};
+}
+
+constexpr auto instanceSize(InstanceFormat format) -> std::size_t
+{
+  std::size_t size = 0;
+  for (auto streamSize : instanceStreamSizes(format)) {
+    size += streamSize;
+  }
+  return size;
+}
+
+// IEEE 754 binary16, rounded to nearest even. Values beyond the half range become infinity.
+auto toHalf(float value) -> std::uint16_t;
+auto fromHalf(std::uint16_t half) -> float;
+
+// Writes the particles [from, to) in spawn order, out points at the first instance of every stream.
+// Compact positions are stored relative to anchor.
+void writeInstances(InstanceFormat format, const ParticleStreams& streams, std::uint64_t from, std::uint64_t to,
+                    const aw::Vec3& anchor, const std::array<unsigned char*, maxInstanceStreams>& out);
+
+// Largest and mean deviation of the compact format from the float format over all resident particles
+struct CompactError
+{
+  std::size_t particles{0};
+  // World position at the given simulation time, including the error of the integrated velocity
+  double positionMax{0.0};
+  double positionMean{0.0};
+  double velocityMax{0.0};
+  double sizeMax{0.0};
+  double rotationMax{0.0};
+  double lifetimeMax{0.0};
+};
+
+auto measureCompactError(const std::vector<SpawnerParticles>& particles, float time) -> CompactError;
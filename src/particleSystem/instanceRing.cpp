@@ -0,0 +1,125 @@
+#include "particleSystem/instanceRing.hpp"
+
+#include "glExt.hpp"
+
+#include <algorithm>
+
+namespace {
+constexpr std::size_t minCapacity = 16384;
+
+constexpr GLbitfield persistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+void wait(GLsync& fence)
+{
+  if (!fence) {
+    return;
+  }
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+} // namespace
+
+InstanceRing::InstanceRing(InstanceFormat format) :
+    mFormat{format}, mStreamSizes{instanceStreamSizes(format)}, mPersistent{glExt::hasBufferStorage()}
+{
+}
+
+InstanceRing::~InstanceRing()
+{
+  release();
+}
+
+auto InstanceRing::map(std::size_t count) -> std::optional<InstanceSegment>
+{
+  if (count > mCapacity) {
+    auto capacity = std::max(mCapacity, minCapacity);
+    while (capacity < count) {
+      capacity *= 2;
+    }
+    allocate(capacity);
+  }
+
+  unsigned char* base = nullptr;
+  std::size_t first = 0;
+  if (mPersistent) {
+    mSegment = (mSegment + 1) % segmentCount;
+    wait(mFences[mSegment]);
+    base = mMapped;
+    first = mSegment * mCapacity;
+  } else {
+    // Orphaning hands the driver a fresh allocation, the draws of the previous frame keep the old one
+    const auto size = static_cast<GLsizeiptr>(streamOffset(maxInstanceStreams));
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    base = static_cast<unsigned char*>(
+        glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!base) {
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+  }
+  if (!base) {
+    return std::nullopt;
+  }
+
+  InstanceSegment segment{{}, count, static_cast<GLuint>(first)};
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    segment.streams[s] = mStreamSizes[s] > 0 ? base + offset(s, first) : nullptr;
+  }
+  return segment;
+}
+
+void InstanceRing::unmap()
+{
+  if (!mPersistent) {
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+}
+
+void InstanceRing::fence()
+{
+  if (mPersistent) {
+    mFences[mSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+void InstanceRing::allocate(std::size_t capacity)
+{
+  release();
+  mCapacity = capacity;
+  glGenBuffers(1, &mBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+  const auto size = static_cast<GLsizeiptr>(streamOffset(maxInstanceStreams));
+  if (mPersistent) {
+    glExt::bufferStorage(GL_ARRAY_BUFFER, size, nullptr, persistentFlags);
+    mMapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, persistentFlags));
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  }
+}
+
+void InstanceRing::release()
+{
+  // A persistent buffer may only be deleted once the GPU stopped reading every segment
+  for (auto& fence : mFences) {
+    wait(fence);
+  }
+  if (mBuffer != 0) {
+    glDeleteBuffers(1, &mBuffer);
+  }
+  mBuffer = 0;
+  mMapped = nullptr;
+  mCapacity = 0;
+}
+
+auto InstanceRing::streamOffset(std::size_t stream) const -> std::size_t
+{
+  const auto segments = mPersistent ? segmentCount : 1;
+  std::size_t offset = 0;
+  for (std::size_t s = 0; s < stream; s++) {
+    offset += segments * mCapacity * mStreamSizes[s];
+  }
+  return offset;
+}
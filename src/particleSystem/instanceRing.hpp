@@ -0,0 +1,73 @@
+#pragma once
+
+#include "aw/graphics/opengl/gl.hpp"
+#include "particleSystem/instanceFormat.hpp"
+
+#include <array>
+#include <cstddef>
+#include <optional>
+
+// Per instance memory for one frame, every stream holds count elements
+struct InstanceSegment
+{
+  std::array<unsigned char*, maxInstanceStreams> streams;
+  std::size_t count;
+  // Instance index of element 0, passed as base instance of the draws
+  GLuint baseInstance;
+};
+
+// GPU buffer holding the particle instances of the last three frames.
+//
+// With GL 4.4 / ARB_buffer_storage the buffer is allocated once with glBufferStorage and stays persistently and
+// coherently mapped. Every stream is split into three segments used round robin, a fence placed after the draws of a
+// frame guards its segment until the GPU finished reading it. Without buffer storage the whole buffer is orphaned with
+// glBufferData and mapped every frame.
+class InstanceRing
+{
+public:
+  static constexpr std::size_t segmentCount = 3;
+
+  InstanceRing(InstanceFormat format);
+  ~InstanceRing();
+
+  InstanceRing(const InstanceRing&) = delete;
+  auto operator=(const InstanceRing&) -> InstanceRing& = delete;
+
+  auto persistent() const -> bool { return mPersistent; }
+  auto format() const -> InstanceFormat { return mFormat; }
+  auto buffer() const -> GLuint { return mBuffer; }
+
+  // Byte offset of an instance (counted like InstanceSegment::baseInstance) in a stream
+  auto offset(std::size_t stream, std::size_t instance) const -> GLintptr
+  {
+    return static_cast<GLintptr>(streamOffset(stream) + instance * mStreamSizes[stream]);
+  }
+
+  // Returns writable memory for count instances, blocks if the GPU still reads the segment of three frames ago.
+  // Grows the buffer if count exceeds its capacity. std::nullopt if the buffer could not be mapped (out of memory, lost
+  // context), nothing is left bound and unmap must not be called then.
+  auto map(std::size_t count) -> std::optional<InstanceSegment>;
+  // Publishes the instances written since map(), call before drawing them
+  void unmap();
+  // Call once the draws reading the current segment were issued
+  void fence();
+
+private:
+  void allocate(std::size_t capacity);
+  void release();
+  auto streamOffset(std::size_t stream) const -> std::size_t;
+
+private:
+  InstanceFormat mFormat;
+  std::array<std::size_t, maxInstanceStreams> mStreamSizes;
+  bool mPersistent{false};
+
+  GLuint mBuffer{0};
+  // Instances per segment
+  std::size_t mCapacity{0};
+  // Persistent mapping of the whole buffer
+  unsigned char* mMapped{nullptr};
+
+  std::size_t mSegment{0};
+  std::array<GLsync, segmentCount> mFences{};
+};
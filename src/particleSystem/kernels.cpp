@@ -0,0 +1,215 @@
+#include "particleSystem/kernels.hpp"
+
+#include "particleSystem/simd.hpp"
+
+namespace kernels {
+namespace {
+using FindAliveFn = std::size_t (*)(const float* aliveUntil, std::size_t count, float time);
+using IntegrateFn = void (*)(const aw::Vec4* positionSize, const aw::Vec2* velocity, const float* aliveUntil,
+                             const float* aliveFor, std::size_t count, float time, aw::Vec4* out);
+
+struct Dispatch
+{
+  Isa isa;
+  FindAliveFn findAlive;
+  IntegrateFn integrate;
+};
+
+std::size_t findAliveScalar(const float* aliveUntil, std::size_t count, float time)
+{
+  for (std::size_t i = 0; i < count; i++) {
+    if (aliveUntil[i] > time) {
+      return i;
+    }
+  }
+  return count;
+}
+
+void integrateScalar(const aw::Vec4* positionSize, const aw::Vec2* velocity, const float* aliveUntil,
+                     const float* aliveFor, std::size_t count, float time, aw::Vec4* out)
+{
+  for (std::size_t i = 0; i < count; i++) {
+    const auto age = time - (aliveUntil[i] - aliveFor[i]);
+    out[i] = aw::Vec4(positionSize[i].x + velocity[i].x * age, positionSize[i].y + velocity[i].y * age,
+                      positionSize[i].z, positionSize[i].w);
+  }
+}
+
+#if defined(AW_KERNELS_X86)
+AW_TARGET("sse4.1") std::size_t findAliveSse41(const float* aliveUntil, std::size_t count, float time)
+{
+  const auto t = _mm_set1_ps(time);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto alive = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(aliveUntil + i), t));
+    if (alive != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(alive)));
+    }
+  }
+  return i + findAliveScalar(aliveUntil + i, count - i, time);
+}
+
+AW_TARGET("sse4.1")
+void integrateSse41(const aw::Vec4* positionSize, const aw::Vec2* velocity, const float* aliveUntil,
+                    const float* aliveFor, std::size_t count, float time, aw::Vec4* out)
+{
+  for (std::size_t i = 0; i < count; i++) {
+    const auto age = _mm_set1_ps(time - (aliveUntil[i] - aliveFor[i]));
+    const auto v = _mm_setr_ps(velocity[i].x, velocity[i].y, 0.f, 0.f);
+    const auto p = _mm_loadu_ps(&positionSize[i].x);
+    _mm_storeu_ps(&out[i].x, _mm_add_ps(p, _mm_mul_ps(v, age)));
+  }
+}
+
+AW_TARGET("avx2") std::size_t findAliveAvx2(const float* aliveUntil, std::size_t count, float time)
+{
+  const auto t = _mm256_set1_ps(time);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const auto alive = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(aliveUntil + i), t, _CMP_GT_OQ));
+    if (alive != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(alive)));
+    }
+  }
+  return i + findAliveScalar(aliveUntil + i, count - i, time);
+}
+
+AW_TARGET("avx2")
+void integrateAvx2(const aw::Vec4* positionSize, const aw::Vec2* velocity, const float* aliveUntil,
+                   const float* aliveFor, std::size_t count, float time, aw::Vec4* out)
+{
+  std::size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const auto age0 = time - (aliveUntil[i] - aliveFor[i]);
+    const auto age1 = time - (aliveUntil[i + 1] - aliveFor[i + 1]);
+    const auto age = _mm256_setr_ps(age0, age0, age0, age0, age1, age1, age1, age1);
+    const auto v = _mm256_setr_ps(velocity[i].x, velocity[i].y, 0.f, 0.f, velocity[i + 1].x, velocity[i + 1].y, 0.f,
+                                  0.f);
+    const auto p = _mm256_loadu_ps(&positionSize[i].x);
+    _mm256_storeu_ps(&out[i].x, _mm256_add_ps(p, _mm256_mul_ps(v, age)));
+  }
+  integrateScalar(positionSize + i, velocity + i, aliveUntil + i, aliveFor + i, count - i, time, out + i);
+}
+
+auto cpuSupportsAvx2() -> bool
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_cpu_supports("avx2");
+#else
+  int info[4];
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+auto cpuSupportsSse41() -> bool
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_cpu_supports("sse4.1");
+#else
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 19)) != 0;
+#endif
+}
+#endif
+
+#if defined(AW_KERNELS_NEON)
+std::size_t findAliveNeon(const float* aliveUntil, std::size_t count, float time)
+{
+  const auto t = vdupq_n_f32(time);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const auto alive = vcgtq_f32(vld1q_f32(aliveUntil + i), t);
+    if ((vgetq_lane_u32(alive, 0) | vgetq_lane_u32(alive, 1) | vgetq_lane_u32(alive, 2) | vgetq_lane_u32(alive, 3)) !=
+        0) {
+      return i + findAliveScalar(aliveUntil + i, 4, time);
+    }
+  }
+  return i + findAliveScalar(aliveUntil + i, count - i, time);
+}
+
+void integrateNeon(const aw::Vec4* positionSize, const aw::Vec2* velocity, const float* aliveUntil,
+                   const float* aliveFor, std::size_t count, float time, aw::Vec4* out)
+{
+  for (std::size_t i = 0; i < count; i++) {
+    const auto age = vdupq_n_f32(time - (aliveUntil[i] - aliveFor[i]));
+    const float v[4] = {velocity[i].x, velocity[i].y, 0.f, 0.f};
+    vst1q_f32(&out[i].x, vaddq_f32(vld1q_f32(&positionSize[i].x), vmulq_f32(vld1q_f32(v), age)));
+  }
+}
+#endif
+
+auto selectDispatch() -> Dispatch
+{
+#if defined(AW_KERNELS_X86)
+  if (cpuSupportsAvx2()) {
+    return {Isa::Avx2, findAliveAvx2, integrateAvx2};
+  }
+  if (cpuSupportsSse41()) {
+    return {Isa::Sse41, findAliveSse41, integrateSse41};
+  }
+#elif defined(AW_KERNELS_NEON)
+  return {Isa::Neon, findAliveNeon, integrateNeon};
+#endif
+  return {Isa::Scalar, findAliveScalar, integrateScalar};
+}
+
+const Dispatch& dispatch()
+{
+  static const Dispatch selected = selectDispatch();
+  return selected;
+}
+} // namespace
+
+auto activeIsa() -> Isa
+{
+  return dispatch().isa;
+}
+
+auto isaName(Isa isa) -> const char*
+{
+  switch (isa) {
+  case Isa::Avx2:
+    return "avx2";
+  case Isa::Sse41:
+    return "sse4.1";
+  case Isa::Neon:
+    return "neon";
+  case Isa::Scalar:
+    break;
+  }
+  return "scalar";
+}
+
+auto findAlive(const float* aliveUntil, std::size_t count, float time) -> std::size_t
+{
+  return dispatch().findAlive(aliveUntil, count, time);
+}
+
+auto retire(ParticleStreams& streams, float time) -> std::size_t
+{
+  const auto& d = dispatch();
+  std::size_t retired = 0;
+  for (const auto& range : streams.ranges()) {
+    const auto expired = d.findAlive(streams.aliveUntil.data() + range.first, range.count, time);
+    retired += expired;
+    if (expired < range.count) {
+      break;
+    }
+  }
+  streams.retire(retired);
+  return retired;
+}
+
+void integrate(const ParticleStreams& streams, float time, aw::Vec4* out)
+{
+  const auto& d = dispatch();
+  for (const auto& range : streams.ranges()) {
+    d.integrate(streams.positionSize.data() + range.first, streams.velocity.data() + range.first,
+                streams.aliveUntil.data() + range.first, streams.aliveFor.data() + range.first, range.count, time,
+                out);
+    out += range.count;
+  }
+}
+} // namespace kernels
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "particleSystem/streams.hpp"
+
+#include <cstddef>
+
+// Hot loops over particle streams. The instruction set is selected once at startup (AVX2, SSE4.1, NEON or scalar),
+// all variants produce identical results.
+namespace kernels {
+enum class Isa
+{
+  Scalar,
+  Sse41,
+  Avx2,
+  Neon,
+};
+
+auto activeIsa() -> Isa;
+auto isaName(Isa isa) -> const char*;
+
+// Index of the first particle with aliveUntil > time, count if every particle is expired
+auto findAlive(const float* aliveUntil, std::size_t count, float time) -> std::size_t;
+
+// Retires expired particles from the tail of the ring up to the first alive one, returns the number retired.
+// Costs O(retired), particles expiring out of spawn order stay resident until everything spawned before them expired.
+auto retire(ParticleStreams& streams, float time) -> std::size_t;
+
+// Writes the current world position (xyz) and spawn size (w) of every resident particle in spawn order into out
+void integrate(const ParticleStreams& streams, float time, aw::Vec4* out);
+} // namespace kernels
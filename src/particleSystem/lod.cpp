@@ -0,0 +1,81 @@
+#include "particleSystem/lod.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+auto spawnerDetail(const SpawnerLod& lod, const LodView& view, const aw::Vec3& origin, const ParticleBounds& bounds)
+    -> SpawnerDetail
+{
+  const aw::Vec3 offset{origin.x - view.eye.x, origin.y - view.eye.y, origin.z - view.eye.z};
+  const auto distance = std::sqrt(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+
+  SpawnerDetail detail;
+  if ((lod.sleepDistance > 0.f && distance > lod.sleepDistance) ||
+      (lod.sleepInvisible && classify(bounds, view.view) == Visibility::Outside)) {
+    detail.sleeping = true;
+    return detail;
+  }
+  auto tierDistance = 0.f;
+  for (const auto& tier : lod.tiers) {
+    if (tier.distance <= distance && tier.distance >= tierDistance) {
+      tierDistance = tier.distance;
+      detail.amountScale = tier.amountScale;
+    }
+  }
+  return detail;
+}
+
+auto lodPath(const aw::fs::path& spawnerPath) -> aw::fs::path
+{
+  auto path = spawnerPath;
+  path += ".lod";
+  return path;
+}
+
+auto loadLod(const aw::fs::path& path) -> std::optional<SpawnerLod>
+{
+  std::ifstream file(path);
+  if (!file) {
+    return std::nullopt;
+  }
+
+  SpawnerLod lod;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    if (!(fields >> key)) {
+      continue;
+    }
+    if (key == "sleepDistance") {
+      fields >> lod.sleepDistance;
+    } else if (key == "sleepInvisible") {
+      fields >> lod.sleepInvisible;
+    } else if (key == "priority") {
+      fields >> lod.priority;
+    } else if (key == "tier") {
+      auto& tier = lod.tiers.emplace_back();
+      fields >> tier.distance >> tier.amountScale;
+    } else {
+      return std::nullopt;
+    }
+    if (fields.fail()) {
+      return std::nullopt;
+    }
+  }
+  return lod;
+}
+
+auto saveLod(const aw::fs::path& path, const SpawnerLod& lod) -> bool
+{
+  std::ofstream file(path);
+  file << "sleepDistance " << lod.sleepDistance << "\n";
+  file << "sleepInvisible " << (lod.sleepInvisible ? 1 : 0) << "\n";
+  file << "priority " << lod.priority << "\n";
+  for (const auto& tier : lod.tiers) {
+    file << "tier " << tier.distance << " " << tier.amountScale << "\n";
+  }
+  return static_cast<bool>(file);
+}
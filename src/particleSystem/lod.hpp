@@ -0,0 +1,56 @@
+#pragma once
+
+#include "aw/util/filesystem/fileStream.hpp"
+#include "aw/util/math/vector.hpp"
+#include "particleSystem/bounds.hpp"
+
+#include <optional>
+#include <vector>
+
+// Level of detail of a spawner, an optional component next to aw::ParticleSpawner. Spawners without it are always
+// simulated at full detail.
+struct SpawnerLod
+{
+  struct Tier
+  {
+    // Camera distance from which the tier applies
+    float distance;
+    // Factor on every sampled burst amount
+    float amountScale;
+  };
+  // The tier with the largest distance not beyond the camera distance applies, in any order
+  std::vector<Tier> tiers;
+
+  // Spawners farther away than this are not simulated, 0 never sleeps by distance
+  float sleepDistance{0.f};
+  // Spawners whose bursts could not reach the view are not simulated
+  bool sleepInvisible{false};
+
+  // Over the particle budget, spawners of lower priority are throttled and culled first
+  int priority{0};
+};
+
+// Camera the detail of every spawner is chosen for
+struct LodView
+{
+  aw::Vec3 eye;
+  CullView view;
+};
+
+struct SpawnerDetail
+{
+  bool sleeping{false};
+  float amountScale{1.f};
+};
+
+// bounds covers every position a burst spawned now could reach, see burstBounds
+auto spawnerDetail(const SpawnerLod& lod, const LodView& view, const aw::Vec3& origin, const ParticleBounds& bounds)
+    -> SpawnerDetail;
+
+// The .awps file is written by the engine's serializer, the tiers are stored next to it in "<name>.awps.lod".
+// Lines are "sleepDistance <distance>", "sleepInvisible <0|1>", "priority <priority>" and
+// "tier <distance> <amount scale>".
+auto lodPath(const aw::fs::path& spawnerPath) -> aw::fs::path;
+// std::nullopt if the file does not exist or is malformed
+auto loadLod(const aw::fs::path& path) -> std::optional<SpawnerLod>;
+auto saveLod(const aw::fs::path& path, const SpawnerLod& lod) -> bool;
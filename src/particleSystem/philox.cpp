@@ -0,0 +1,222 @@
+#include "particleSystem/philox.hpp"
+
+#include "particleSystem/kernels.hpp"
+#include "particleSystem/simd.hpp"
+
+namespace philox {
+namespace {
+constexpr std::uint32_t multiplier0 = 0xD2511F53u;
+constexpr std::uint32_t multiplier1 = 0xCD9E8D57u;
+constexpr std::uint32_t weyl0 = 0x9E3779B9u;
+constexpr std::uint32_t weyl1 = 0xBB67AE85u;
+constexpr int rounds = 10;
+
+// out and count describe the indices handled by this call, stride is the count of the whole fill() call
+using FillFn = void (*)(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+                        std::uint32_t* out, std::size_t stride);
+
+void fillScalar(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+                std::uint32_t* out, std::size_t stride)
+{
+  for (std::size_t i = 0; i < count; i++) {
+    for (std::uint32_t b = 0; b < blocks; b++) {
+      const auto words = generate(key, counter(stream, firstIndex + i, b));
+      for (std::size_t w = 0; w < 4; w++) {
+        out[(b * 4 + w) * stride + i] = words[w];
+      }
+    }
+  }
+}
+
+#if defined(AW_KERNELS_X86)
+// The 32x32 -> 64 bit multiplies only exist for the even lanes, the odd lanes are shifted down for a second multiply
+AW_TARGET("sse4.1") void mulhilo(__m128i a, __m128i m, __m128i& hi, __m128i& lo)
+{
+  const auto even = _mm_mul_epu32(a, m);
+  const auto odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+  hi = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+  lo = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+}
+
+AW_TARGET("sse4.1")
+void fillSse41(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+               std::uint32_t* out, std::size_t stride)
+{
+  const auto m0 = _mm_set1_epi32(static_cast<int>(multiplier0));
+  const auto m1 = _mm_set1_epi32(static_cast<int>(multiplier1));
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    alignas(16) std::uint32_t indexLo[4];
+    alignas(16) std::uint32_t indexHi[4];
+    for (std::size_t lane = 0; lane < 4; lane++) {
+      indexLo[lane] = static_cast<std::uint32_t>(firstIndex + i + lane);
+      indexHi[lane] = static_cast<std::uint32_t>((firstIndex + i + lane) >> 32);
+    }
+    for (std::uint32_t b = 0; b < blocks; b++) {
+      auto c0 = _mm_set1_epi32(static_cast<int>(b));
+      auto c1 = _mm_set1_epi32(static_cast<int>(stream));
+      auto c2 = _mm_load_si128(reinterpret_cast<const __m128i*>(indexLo));
+      auto c3 = _mm_load_si128(reinterpret_cast<const __m128i*>(indexHi));
+      auto k0 = key.k0;
+      auto k1 = key.k1;
+      for (int r = 0; r < rounds; r++) {
+        __m128i hi0, lo0, hi1, lo1;
+        mulhilo(c0, m0, hi0, lo0);
+        mulhilo(c2, m1, hi1, lo1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(static_cast<int>(k0)));
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(static_cast<int>(k1)));
+        c3 = lo0;
+        k0 += weyl0;
+        k1 += weyl1;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (b * 4 + 0) * stride + i), c0);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (b * 4 + 1) * stride + i), c1);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (b * 4 + 2) * stride + i), c2);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (b * 4 + 3) * stride + i), c3);
+    }
+  }
+  fillScalar(key, stream, firstIndex + i, count - i, blocks, out + i, stride);
+}
+
+AW_TARGET("avx2") void mulhilo(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+{
+  const auto even = _mm256_mul_epu32(a, m);
+  const auto odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+  hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+  lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+AW_TARGET("avx2")
+void fillAvx2(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+              std::uint32_t* out, std::size_t stride)
+{
+  const auto m0 = _mm256_set1_epi32(static_cast<int>(multiplier0));
+  const auto m1 = _mm256_set1_epi32(static_cast<int>(multiplier1));
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    alignas(32) std::uint32_t indexLo[8];
+    alignas(32) std::uint32_t indexHi[8];
+    for (std::size_t lane = 0; lane < 8; lane++) {
+      indexLo[lane] = static_cast<std::uint32_t>(firstIndex + i + lane);
+      indexHi[lane] = static_cast<std::uint32_t>((firstIndex + i + lane) >> 32);
+    }
+    for (std::uint32_t b = 0; b < blocks; b++) {
+      auto c0 = _mm256_set1_epi32(static_cast<int>(b));
+      auto c1 = _mm256_set1_epi32(static_cast<int>(stream));
+      auto c2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(indexLo));
+      auto c3 = _mm256_load_si256(reinterpret_cast<const __m256i*>(indexHi));
+      auto k0 = key.k0;
+      auto k1 = key.k1;
+      for (int r = 0; r < rounds; r++) {
+        __m256i hi0, lo0, hi1, lo1;
+        mulhilo(c0, m0, hi0, lo0);
+        mulhilo(c2, m1, hi1, lo1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(k0)));
+        c1 = lo1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(k1)));
+        c3 = lo0;
+        k0 += weyl0;
+        k1 += weyl1;
+      }
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (b * 4 + 0) * stride + i), c0);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (b * 4 + 1) * stride + i), c1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (b * 4 + 2) * stride + i), c2);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (b * 4 + 3) * stride + i), c3);
+    }
+  }
+  fillSse41(key, stream, firstIndex + i, count - i, blocks, out + i, stride);
+}
+#endif
+
+#if defined(AW_KERNELS_NEON)
+void mulhilo(uint32x4_t a, uint32x2_t m, uint32x4_t& hi, uint32x4_t& lo)
+{
+  const auto low = vmull_u32(vget_low_u32(a), m);
+  const auto high = vmull_u32(vget_high_u32(a), m);
+  hi = vcombine_u32(vshrn_n_u64(low, 32), vshrn_n_u64(high, 32));
+  lo = vcombine_u32(vmovn_u64(low), vmovn_u64(high));
+}
+
+void fillNeon(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+              std::uint32_t* out, std::size_t stride)
+{
+  const auto m0 = vdup_n_u32(multiplier0);
+  const auto m1 = vdup_n_u32(multiplier1);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    std::uint32_t indexLo[4];
+    std::uint32_t indexHi[4];
+    for (std::size_t lane = 0; lane < 4; lane++) {
+      indexLo[lane] = static_cast<std::uint32_t>(firstIndex + i + lane);
+      indexHi[lane] = static_cast<std::uint32_t>((firstIndex + i + lane) >> 32);
+    }
+    for (std::uint32_t b = 0; b < blocks; b++) {
+      auto c0 = vdupq_n_u32(b);
+      auto c1 = vdupq_n_u32(static_cast<std::uint32_t>(stream));
+      auto c2 = vld1q_u32(indexLo);
+      auto c3 = vld1q_u32(indexHi);
+      auto k0 = key.k0;
+      auto k1 = key.k1;
+      for (int r = 0; r < rounds; r++) {
+        uint32x4_t hi0, lo0, hi1, lo1;
+        mulhilo(c0, m0, hi0, lo0);
+        mulhilo(c2, m1, hi1, lo1);
+        c0 = veorq_u32(veorq_u32(hi1, c1), vdupq_n_u32(k0));
+        c1 = lo1;
+        c2 = veorq_u32(veorq_u32(hi0, c3), vdupq_n_u32(k1));
+        c3 = lo0;
+        k0 += weyl0;
+        k1 += weyl1;
+      }
+      vst1q_u32(out + (b * 4 + 0) * stride + i, c0);
+      vst1q_u32(out + (b * 4 + 1) * stride + i, c1);
+      vst1q_u32(out + (b * 4 + 2) * stride + i, c2);
+      vst1q_u32(out + (b * 4 + 3) * stride + i, c3);
+    }
+  }
+  fillScalar(key, stream, firstIndex + i, count - i, blocks, out + i, stride);
+}
+#endif
+
+auto selectFill() -> FillFn
+{
+  switch (kernels::activeIsa()) {
+#if defined(AW_KERNELS_X86)
+  case kernels::Isa::Avx2:
+    return fillAvx2;
+  case kernels::Isa::Sse41:
+    return fillSse41;
+#elif defined(AW_KERNELS_NEON)
+  case kernels::Isa::Neon:
+    return fillNeon;
+#endif
+  default:
+    break;
+  }
+  return fillScalar;
+}
+} // namespace
+
+auto generate(Key key, Block counter) -> Block
+{
+  for (int r = 0; r < rounds; r++) {
+    const auto product0 = static_cast<std::uint64_t>(multiplier0) * counter[0];
+    const auto product1 = static_cast<std::uint64_t>(multiplier1) * counter[2];
+    const auto hi0 = static_cast<std::uint32_t>(product0 >> 32);
+    const auto hi1 = static_cast<std::uint32_t>(product1 >> 32);
+    counter = {hi1 ^ counter[1] ^ key.k0, static_cast<std::uint32_t>(product1), hi0 ^ counter[3] ^ key.k1,
+               static_cast<std::uint32_t>(product0)};
+    key.k0 += weyl0;
+    key.k1 += weyl1;
+  }
+  return counter;
+}
+
+void fill(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+          std::uint32_t* out)
+{
+  static const FillFn selected = selectFill();
+  selected(key, stream, firstIndex, count, blocks, out, count);
+}
+} // namespace philox
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Philox4x32-10 counter based random numbers (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// Every 128 bit block is a pure function of a key and a counter, so any sample can be regenerated without walking a
+// generator state and batches for many counters are generated side by side in SIMD lanes.
+//
+// Counter layout: {block, stream, index low bits, index high bits}. The index is the particle's sequence number
+// (or the burst number of a spawner), block enumerates the blocks consumed by that index.
+namespace philox {
+using Block = std::array<std::uint32_t, 4>;
+
+struct Key
+{
+  std::uint32_t k0;
+  std::uint32_t k1;
+};
+
+// Independent sequences for the same key and index
+enum class Stream : std::uint32_t
+{
+  Particle = 0,
+  Schedule = 1,
+};
+
+auto generate(Key key, Block counter) -> Block;
+
+inline auto counter(Stream stream, std::uint64_t index, std::uint32_t block) -> Block
+{
+  return {block, static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(index),
+          static_cast<std::uint32_t>(index >> 32)};
+}
+
+// Generates blocks [0, blocks) of the indices [firstIndex, firstIndex + count). Word w (= block * 4 + component) of
+// index firstIndex + i is written to out[w * count + i], out has to hold blocks * 4 * count words.
+// Uses the instruction set of kernels::activeIsa(), every variant produces identical words.
+void fill(Key key, Stream stream, std::uint64_t firstIndex, std::size_t count, std::uint32_t blocks,
+          std::uint32_t* out);
+
+// Uniform random bit generator over the words of a single index. Words generated ahead of time by fill() are served
+// first (prefetched points at word 0 of the index, stride is the count passed to fill), further blocks are generated
+// on demand. The sequence is the same whether or not words were prefetched.
+class Generator
+{
+public:
+  using result_type = std::uint32_t;
+
+  static constexpr auto min() -> result_type { return 0; }
+  static constexpr auto max() -> result_type { return 0xffffffffu; }
+
+  Generator(Key key, Stream stream, std::uint64_t index) : mKey{key}, mStream{stream}, mIndex{index} {}
+  Generator(Key key, Stream stream, std::uint64_t index, const std::uint32_t* prefetched, std::size_t stride,
+            std::uint32_t prefetchedBlocks) :
+      mKey{key},
+      mStream{stream},
+      mIndex{index},
+      mPrefetched{prefetched},
+      mStride{stride},
+      mPrefetchedWords{prefetchedBlocks * 4},
+      mNextBlock{prefetchedBlocks}
+  {
+  }
+
+  auto operator()() -> result_type
+  {
+    if (mPosition < mPrefetchedWords) {
+      return mPrefetched[mPosition++ * mStride];
+    }
+    if (mBufferPosition == mBuffer.size()) {
+      mBuffer = generate(mKey, counter(mStream, mIndex, mNextBlock++));
+      mBufferPosition = 0;
+    }
+    return mBuffer[mBufferPosition++];
+  }
+
+private:
+  Key mKey;
+  Stream mStream;
+  std::uint64_t mIndex;
+
+  const std::uint32_t* mPrefetched{nullptr};
+  std::size_t mStride{0};
+  std::uint32_t mPrefetchedWords{0};
+  std::uint32_t mPosition{0};
+
+  std::uint32_t mNextBlock{0};
+  Block mBuffer{};
+  std::size_t mBufferPosition{4};
+};
+} // namespace philox
@@ -0,0 +1,150 @@
+#include "particleSystem/pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// End of a free list
+constexpr std::size_t none = ~std::size_t{0};
+} // namespace
+
+ParticlePool::ParticlePool(std::size_t capacity) :
+    mCapacity{(capacity + blockSize - 1) / blockSize * blockSize},
+    // Left uninitialized, pages of the arena are only touched once a span in them is split or handed out
+    mArena{new unsigned char[mCapacity * particleBytes]},
+    mFreeOrders(mCapacity / minSpan, 0)
+{
+  std::size_t orders = 1;
+  while (spanSize(orders) <= mCapacity) {
+    orders++;
+  }
+  mFree.resize(orders, none);
+
+  // The arena starts as the largest aligned spans that fit, a single one for a power of two capacity
+  for (std::size_t offset = 0; offset < mCapacity;) {
+    auto spanOrder = orders - 1;
+    while (offset % spanSize(spanOrder) != 0 || offset + spanSize(spanOrder) > mCapacity) {
+      spanOrder--;
+    }
+    pushFree(spanOrder, offset);
+    offset += spanSize(spanOrder);
+  }
+}
+
+auto ParticlePool::allocate(std::size_t particles) -> unsigned char*
+{
+  const auto wanted = order(particles);
+  std::lock_guard lock{mMutex};
+
+  // The smallest free span that fits, the upper halves split off are freed again
+  auto found = wanted;
+  while (found < mFree.size() && mFree[found] == none) {
+    found++;
+  }
+  if (found >= mFree.size()) {
+    mCounters.failed++;
+    return nullptr;
+  }
+  const auto offset = mFree[found];
+  removeFree(found, offset);
+  while (found > wanted) {
+    found--;
+    pushFree(found, offset + spanSize(found));
+  }
+
+  const auto end = offset + spanSize(wanted);
+  mCounters.recycled += end <= mCarved ? 1 : 0;
+  mCarved = std::max(mCarved, end);
+  mUsed += spanSize(wanted);
+  mCounters.allocations++;
+  return mArena.get() + offset * particleBytes;
+}
+
+void ParticlePool::release(unsigned char* span, std::size_t particles)
+{
+  if (!span) {
+    return;
+  }
+  auto offset = static_cast<std::size_t>(span - mArena.get()) / particleBytes;
+  auto released = order(particles);
+  std::lock_guard lock{mMutex};
+  mUsed -= spanSize(released);
+  mCounters.releases++;
+
+  // Spans are aligned to their size, the buddy of a span is the other half of the span twice its size
+  while (released + 1 < mFree.size()) {
+    const auto buddy = offset ^ spanSize(released);
+    if (buddy + spanSize(released) > mCapacity || mFreeOrders[buddy / minSpan] != released + 1) {
+      break;
+    }
+    removeFree(released, buddy);
+    offset = std::min(offset, buddy);
+    released++;
+  }
+  pushFree(released, offset);
+}
+
+auto ParticlePool::used() const -> std::size_t
+{
+  std::lock_guard lock{mMutex};
+  return mUsed;
+}
+
+auto ParticlePool::carved() const -> std::size_t
+{
+  std::lock_guard lock{mMutex};
+  return mCarved;
+}
+
+auto ParticlePool::counters() const -> Counters
+{
+  std::lock_guard lock{mMutex};
+  return mCounters;
+}
+
+void ParticlePool::resetCounters()
+{
+  std::lock_guard lock{mMutex};
+  mCounters = {};
+}
+
+auto ParticlePool::order(std::size_t particles) -> std::size_t
+{
+  std::size_t result = 0;
+  while (spanSize(result) < particles) {
+    result++;
+  }
+  return result;
+}
+
+auto ParticlePool::links(std::size_t offset) -> unsigned char*
+{
+  return mArena.get() + offset * particleBytes;
+}
+
+void ParticlePool::pushFree(std::size_t order, std::size_t offset)
+{
+  const std::size_t entry[2] = {none, mFree[order]};
+  std::memcpy(links(offset), entry, sizeof(entry));
+  if (mFree[order] != none) {
+    std::memcpy(links(mFree[order]), &offset, sizeof(offset));
+  }
+  mFree[order] = offset;
+  mFreeOrders[offset / minSpan] = static_cast<std::uint8_t>(order + 1);
+}
+
+void ParticlePool::removeFree(std::size_t order, std::size_t offset)
+{
+  std::size_t entry[2];
+  std::memcpy(entry, links(offset), sizeof(entry));
+  const auto [previous, next] = entry;
+  if (previous != none) {
+    std::memcpy(links(previous) + sizeof(std::size_t), &next, sizeof(next));
+  } else {
+    mFree[order] = next;
+  }
+  if (next != none) {
+    std::memcpy(links(next), &previous, sizeof(previous));
+  }
+  mFreeOrders[offset / minSpan] = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "aw/util/math/vector.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Storage of the particle rings of a ParticleSimulation. The arena of the configured capacity (whole blocks of
+// blockSize particles) is allocated once. Rings get spans of a power of two particles holding their five streams back
+// to back, handed out by a buddy allocator: a span is split off the smallest free span that fits and is aligned to its
+// size. A released span is merged with its buddy, the other half of the span twice its size, whenever that one is free
+// as well, so the spans a ring leaves behind while growing become one again and can hold a larger ring. Rings growing
+// during bursts and spawners coming and going never touch the heap.
+class ParticlePool
+{
+public:
+  static constexpr std::size_t minSpan = 64;
+  static constexpr std::size_t blockSize = 4096;
+  // Bytes of one particle across the streams of ParticleStreams
+  static constexpr std::size_t particleBytes = sizeof(aw::Vec4) + sizeof(aw::Vec2) + 3 * sizeof(float);
+  static constexpr std::size_t defaultCapacity = std::size_t{1} << 22;
+
+  // Span operations since the last resetCounters
+  struct Counters
+  {
+    // Spans handed out, recycled ones included
+    std::size_t allocations{0};
+    // Spans below carved, in memory handed out before
+    std::size_t recycled{0};
+    std::size_t releases{0};
+    // Allocations refused because the arena is exhausted
+    std::size_t failed{0};
+  };
+
+  // Capacity in particles, rounded up to whole blocks
+  explicit ParticlePool(std::size_t capacity = defaultCapacity);
+
+  ParticlePool(const ParticlePool&) = delete;
+  auto operator=(const ParticlePool&) -> ParticlePool& = delete;
+
+  // Span of particles particles, a power of two of at least minSpan. nullptr if the arena is exhausted. Thread safe.
+  auto allocate(std::size_t particles) -> unsigned char*;
+  void release(unsigned char* span, std::size_t particles);
+
+  auto capacity() const -> std::size_t { return mCapacity; }
+  // Particles in spans handed out
+  auto used() const -> std::size_t;
+  // End of the highest span handed out so far in particles, the arena beyond it was never touched
+  auto carved() const -> std::size_t;
+  auto counters() const -> Counters;
+  void resetCounters();
+
+private:
+  static auto order(std::size_t particles) -> std::size_t;
+  static constexpr auto spanSize(std::size_t order) -> std::size_t { return minSpan << order; }
+
+  // The first bytes of a free span hold the offsets of the previous and next free span of the same order, spans are
+  // identified by their offset in particles
+  auto links(std::size_t offset) -> unsigned char*;
+  void pushFree(std::size_t order, std::size_t offset);
+  void removeFree(std::size_t order, std::size_t offset);
+
+  mutable std::mutex mMutex;
+  std::size_t mCapacity;
+  std::unique_ptr<unsigned char[]> mArena;
+  std::size_t mCarved{0};
+  std::size_t mUsed{0};
+  // Head of the free list of every order
+  std::vector<std::size_t> mFree;
+  // Per minSpan particles of the arena: order + 1 if a free span starts there, 0 otherwise
+  std::vector<std::uint8_t> mFreeOrders;
+  Counters mCounters;
+};
@@ -0,0 +1,866 @@
+#include "particleSystem/renderer.hpp"
+
+#include "glExt.hpp"
+#include "particleSystem/shader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace {
+constexpr GLsizei gradientResolution = 64;
+constexpr std::size_t initialGradientLayers = 16;
+// Upper bound of a gradient window, GL guarantees only 16 KiB uniform blocks
+constexpr std::size_t maxGradientWindowBytes = 64 * 1024;
+
+// Pulled quads, see particleSprites.comp
+constexpr GLuint spriteGroupSize = 64;
+// Smallest GL_MAX_COMPUTE_WORK_GROUP_COUNT the spec allows
+constexpr GLuint maxWorkGroups = 65535;
+constexpr std::size_t spriteTexels = 4;
+constexpr std::size_t spriteSize = spriteTexels * 4 * sizeof(float);
+constexpr std::size_t minSpriteCapacity = 1024;
+constexpr GLuint commandsBinding = 5;
+constexpr GLuint spritesBinding = 6;
+constexpr GLuint spriteFirstsBinding = 7;
+
+// Attribute type of every instance stream, stream s is read from attribute location s + 1
+struct InstanceAttribute
+{
+  GLint components;
+  GLenum type;
+};
+
+constexpr std::array<std::array<InstanceAttribute, maxInstanceStreams>, 2> instanceAttributes = {{
+    {{{4, GL_FLOAT}, {2, GL_FLOAT}, {1, GL_FLOAT}, {1, GL_FLOAT}, {1, GL_FLOAT}}},
+    {{{4, GL_HALF_FLOAT}, {2, GL_HALF_FLOAT}, {2, GL_HALF_FLOAT}, {1, GL_FLOAT}, {0, GL_NONE}}},
+}};
+
+auto attributeLocation(std::size_t stream) -> GLuint
+{
+  return static_cast<GLuint>(stream + 1);
+}
+
+// Advances the stream pointers of a segment by offset instances
+auto streamPointers(const InstanceSegment& segment, InstanceFormat format, std::size_t offset)
+    -> std::array<unsigned char*, maxInstanceStreams>
+{
+  const auto sizes = instanceStreamSizes(format);
+  std::array<unsigned char*, maxInstanceStreams> pointers{};
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    pointers[s] = segment.streams[s] ? segment.streams[s] + offset * sizes[s] : nullptr;
+  }
+  return pointers;
+}
+} // namespace
+
+ParticleStreamRenderer::ParticleStreamRenderer(const aw::fs::path& shaderDirectory)
+{
+  mDrawIds = glExt::hasShaderDrawParameters();
+  std::string gradientDefines;
+  if (analyticGradients) {
+    // Windows are bound at multiples of their size, which has to respect the offset alignment
+    GLint maxBlockSize = 0;
+    GLint alignment = 1;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    const auto windowBytes = std::min(static_cast<std::size_t>(maxBlockSize), maxGradientWindowBytes);
+    mGradientWindowSize = std::max<std::size_t>(windowBytes / sizeof(GradientBlock), 1);
+    while (mGradientWindowSize > 1 && (mGradientWindowSize * sizeof(GradientBlock)) % alignment != 0) {
+      mGradientWindowSize--;
+    }
+    gradientDefines = "#define ANALYTIC_GRADIENT\n#define GRADIENT_STOPS " +
+                      std::to_string(std::tuple_size_v<ColorGradient>) + "\n#define GRADIENT_CAPACITY " +
+                      std::to_string(mGradientWindowSize) + "\n";
+  } else {
+    mGradientWindowSize = std::numeric_limits<std::size_t>::max();
+  }
+
+  for (auto format : {InstanceFormat::Float, InstanceFormat::Compact}) {
+    std::string defines = format == InstanceFormat::Compact ? "#define COMPACT_INSTANCES\n" : "";
+    defines += mDrawIds ? "#define DRAW_PARAMETERS\n" : "";
+    defines += gradientDefines;
+    auto& program = mPrograms[static_cast<std::size_t>(format)];
+    program.id = loadShaderProgram({shaderDirectory / "particleShading.glsl", shaderDirectory / "particle.vert"},
+                                   shaderDirectory / "particle.frag", defines);
+    program.viewProjection = glGetUniformLocation(program.id, "viewProjection");
+    program.simulationTime = glGetUniformLocation(program.id, "simulationTime");
+    program.colorGradient = glGetUniformLocation(program.id, "colorGradient");
+    program.drawParameters = glGetUniformLocation(program.id, "drawParameters");
+    program.firstDraw = glGetUniformLocation(program.id, "firstDraw");
+    program.pixelsPerUnit = glGetUniformLocation(program.id, "pixelsPerUnit");
+    program.minPixelSize = glGetUniformLocation(program.id, "minPixelSize");
+  }
+
+  if (glExt::hasComputeShader()) {
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &mStorageAlignment);
+    mMaxSprites = static_cast<std::size_t>(maxTexels) / spriteTexels;
+    mSpritesSupported = true;
+    for (auto format : {InstanceFormat::Float, InstanceFormat::Compact}) {
+      const auto defines = (format == InstanceFormat::Compact ? "#define COMPACT_INSTANCES\n" : "") + gradientDefines;
+      auto& program = mSpritePrograms[static_cast<std::size_t>(format)];
+      program.id = loadComputeProgram(
+          {shaderDirectory / "particleShading.glsl", shaderDirectory / "particleSprites.comp"}, defines);
+      program.viewProjection = glGetUniformLocation(program.id, "viewProjection");
+      program.simulationTime = glGetUniformLocation(program.id, "simulationTime");
+      program.colorGradient = glGetUniformLocation(program.id, "colorGradient");
+      program.drawParameters = glGetUniformLocation(program.id, "drawParameters");
+      program.streamFirst = glGetUniformLocation(program.id, "streamFirst");
+      program.firstCommand = glGetUniformLocation(program.id, "firstCommand");
+      program.firstInstance = glGetUniformLocation(program.id, "firstInstance");
+      program.pixelsPerUnit = glGetUniformLocation(program.id, "pixelsPerUnit");
+      program.minPixelSize = glGetUniformLocation(program.id, "minPixelSize");
+      mSpritesSupported = mSpritesSupported && program.id != 0;
+    }
+    mSpriteDrawProgram = loadShaderProgram(
+        {shaderDirectory / "particleShading.glsl", shaderDirectory / "particleSprite.vert"},
+        shaderDirectory / "particle.frag", gradientDefines);
+    mSpriteSampler = glGetUniformLocation(mSpriteDrawProgram, "sprites");
+    mSpritesSupported = mSpritesSupported && mSpriteDrawProgram != 0;
+
+    glGenVertexArrays(1, &mSpriteVao);
+    glGenBuffers(1, &mSprites);
+    glGenBuffers(1, &mSpriteIndices);
+    glGenBuffers(1, &mSpriteFirstBuffer);
+    reserveSprites(minSpriteCapacity);
+    glGenTextures(1, &mSpriteTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, mSpriteTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mSprites);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+  }
+
+  const std::array<float, 8> quad = {-0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f};
+  glGenVertexArrays(1, &mVao);
+  glBindVertexArray(mVao);
+  glGenBuffers(1, &mQuadBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    glVertexAttribDivisor(attributeLocation(s), 1);
+  }
+  glBindVertexArray(0);
+
+  if (analyticGradients) {
+    glGenBuffers(1, &mGradients);
+  } else {
+    glGenTextures(1, &mGradients);
+    glBindTexture(GL_TEXTURE_1D_ARRAY, mGradients);
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  }
+  growGradients(initialGradientLayers);
+
+  glGenBuffers(1, &mCommandBuffer);
+  glGenBuffers(1, &mDrawParameterBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, mDrawParameterBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(DrawParameters), nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glGenTextures(1, &mDrawParameterTexture);
+  glBindTexture(GL_TEXTURE_BUFFER, mDrawParameterTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mDrawParameterBuffer);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+ParticleStreamRenderer::~ParticleStreamRenderer()
+{
+  for (auto& [spawner, buffers] : mGroups) {
+    releaseStreams(buffers);
+  }
+  glDeleteTextures(1, &mDrawParameterTexture);
+  if (analyticGradients) {
+    glDeleteBuffers(1, &mGradients);
+  } else {
+    glDeleteTextures(1, &mGradients);
+  }
+  glDeleteBuffers(1, &mDrawParameterBuffer);
+  glDeleteBuffers(1, &mCommandBuffer);
+  glDeleteBuffers(1, &mQuadBuffer);
+  glDeleteVertexArrays(1, &mVao);
+  for (auto& program : mPrograms) {
+    glDeleteProgram(program.id);
+  }
+  if (mSpriteVao != 0) {
+    glDeleteTextures(1, &mSpriteTexture);
+    glDeleteBuffers(1, &mSpriteFirstBuffer);
+    glDeleteBuffers(1, &mSpriteIndices);
+    glDeleteBuffers(1, &mSprites);
+    glDeleteVertexArrays(1, &mSpriteVao);
+  }
+  for (auto& program : mSpritePrograms) {
+    glDeleteProgram(program.id);
+  }
+  glDeleteProgram(mSpriteDrawProgram);
+}
+
+void ParticleStreamRenderer::render(const aw::Mat4& viewProjection, float simulationTime,
+                                    const std::vector<SpawnerParticles>& particles)
+{
+  ProfileScope profileRender{mProfiler, "particle render"};
+  if (!beginFrame(mFormat, viewProjection, simulationTime)) {
+    return;
+  }
+  if (mUpload == InstanceUpload::Repack) {
+    renderRepacked(particles);
+  } else {
+    renderAppended(particles);
+  }
+  endFrame();
+}
+
+void ParticleStreamRenderer::render(const aw::Mat4& viewProjection, const GpuParticleSimulation& simulation,
+                                    float timeAhead)
+{
+  ProfileScope profileRender{mProfiler, "particle render"};
+  if (simulation.drawCommands() == 0) {
+    return;
+  }
+  if (!beginFrame(InstanceFormat::Float, viewProjection, simulation.simulationTime() + timeAhead)) {
+    return;
+  }
+
+  // The pool and the draw commands never leave the GPU, only the gradients and draw parameters are updated here.
+  // Sprites mirror the pool slots, both ring ranges of a group start at its base.
+  const auto& groups = simulation.groups();
+  mDrawParameters.resize(groups.size() * GpuParticleSimulation::drawsPerGroup);
+  mSpriteFirsts.resize(groups.size() * GpuParticleSimulation::drawsPerGroup);
+  mSpriteCount = simulation.poolCapacity();
+  for (std::size_t i = 0; i < groups.size(); i++) {
+    const auto& group = groups[i];
+    const auto firstCommand = i * GpuParticleSimulation::drawsPerGroup;
+    std::fill_n(mSpriteFirsts.begin() + static_cast<std::ptrdiff_t>(firstCommand), GpuParticleSimulation::drawsPerGroup,
+                static_cast<GLuint>(group.base));
+    if (group.spawner == entt::null) {
+      continue;
+    }
+    auto& buffers = groupBuffers(group.spawner);
+    buffers.used = true;
+    releaseStreams(buffers);
+    updateGradient(buffers, group.colorGradient, group.fadeIn);
+    for (std::size_t d = 0; d < GpuParticleSimulation::drawsPerGroup; d++) {
+      mDrawParameters[firstCommand + d] = {{0.f, 0.f, 0.f}, gradientIndex(buffers.gradientLayer)};
+    }
+    // The resident count is only known to the GPU, whole groups are culled by the union of their burst bounds
+    if (visible(group.bounds) == Visibility::Outside) {
+      mCulledParticles += group.residentBound;
+      continue;
+    }
+    addBatch(nullptr, gradientWindow(buffers.gradientLayer), firstCommand, GpuParticleSimulation::drawsPerGroup,
+             group.capacity);
+  }
+  submitDraws(InstanceFormat::Float, {simulation.streams(), {}}, simulation.drawCommands());
+  endFrame();
+}
+
+auto ParticleStreamRenderer::beginFrame(InstanceFormat format, const aw::Mat4& viewProjection, float simulationTime)
+    -> bool
+{
+  const auto& program = mPrograms[static_cast<std::size_t>(format)];
+  if (program.id == 0) {
+    return false;
+  }
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // particle.vert adds the translation of viewProjection to the center and again with the corner, the cull matrix
+  // counts it twice as well. The pixel scale is the length of the clip space x and y gradients of the quad plane.
+  GLint viewport[4] = {0, 0, 0, 0};
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  mCullView.clip = viewProjection;
+  mCullView.clip[3] = viewProjection[3] * 2.f;
+  mCullView.pixelsPerUnit = {std::hypot(viewProjection[0][0], viewProjection[1][0]) * viewport[2] * 0.5f,
+                             std::hypot(viewProjection[0][1], viewProjection[1][1]) * viewport[3] * 0.5f};
+  mCullView.minPixelSize = mCulling ? mMinPixelSize : 0.f;
+
+  glUseProgram(program.id);
+  glUniformMatrix4fv(program.viewProjection, 1, GL_FALSE, &viewProjection[0][0]);
+  glUniform1f(program.simulationTime, simulationTime);
+  glUniform1i(program.colorGradient, 0);
+  glUniform1i(program.drawParameters, 1);
+  glUniform2f(program.pixelsPerUnit, mCullView.pixelsPerUnit.x, mCullView.pixelsPerUnit.y);
+  glUniform1f(program.minPixelSize, mCullView.minPixelSize);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, mDrawParameterTexture);
+  glActiveTexture(GL_TEXTURE0);
+  if (!analyticGradients) {
+    glBindTexture(GL_TEXTURE_1D_ARRAY, mGradients);
+  }
+  glBindVertexArray(mVao);
+  mViewProjection = viewProjection;
+  mSimulationTime = simulationTime;
+
+  for (auto& [spawner, buffers] : mGroups) {
+    buffers.used = false;
+    buffers.uploadedBytes = 0;
+  }
+  mUploadedBytes = 0;
+  mDrawCalls = 0;
+  mCulledParticles = 0;
+  mCommands.clear();
+  mDrawParameters.clear();
+  mBatches.clear();
+  mSpriteFirsts.clear();
+  mSpriteCount = 0;
+  return true;
+}
+
+void ParticleStreamRenderer::endFrame()
+{
+  glBindVertexArray(0);
+
+  // Release the buffers of spawners which have no particles anymore
+  for (auto it = mGroups.begin(); it != mGroups.end();) {
+    if (it->second.used) {
+      ++it;
+      continue;
+    }
+    releaseStreams(it->second);
+    mFreeGradientLayers.push_back(it->second.gradientLayer);
+    it = mGroups.erase(it);
+  }
+}
+
+auto ParticleStreamRenderer::uploadedBytes(entt::entity spawner) const -> std::size_t
+{
+  auto it = mGroups.find(spawner);
+  return it != mGroups.end() ? it->second.uploadedBytes : 0;
+}
+
+auto ParticleStreamRenderer::visible(const ParticleBounds& bounds) const -> Visibility
+{
+  return mCulling ? classify(bounds, mCullView) : Visibility::Inside;
+}
+
+void ParticleStreamRenderer::cull(const SpawnerParticles& group)
+{
+  const auto& streams = group.streams;
+  if (streams.empty()) {
+    return;
+  }
+  const auto visibility = visible(group.bounds);
+  if (visibility == Visibility::Inside) {
+    mVisibleRuns.push_back({&group, streams.tail, streams.head});
+    return;
+  }
+  if (visibility == Visibility::Outside) {
+    mCulledParticles += streams.size();
+    return;
+  }
+  // Adjacent visible chunks are merged into one run
+  for (const auto& chunk : group.chunks) {
+    const auto from = std::max(chunk.first, streams.tail);
+    const auto to = std::min(chunk.end, streams.head);
+    if (from >= to) {
+      continue;
+    }
+    if (visible(chunk.bounds) == Visibility::Outside) {
+      mCulledParticles += static_cast<std::size_t>(to - from);
+      continue;
+    }
+    if (!mVisibleRuns.empty() && mVisibleRuns.back().group == &group && mVisibleRuns.back().to == from) {
+      mVisibleRuns.back().to = to;
+    } else {
+      mVisibleRuns.push_back({&group, from, to});
+    }
+  }
+}
+
+void ParticleStreamRenderer::renderRepacked(const std::vector<SpawnerParticles>& particles)
+{
+  mVisibleRuns.clear();
+  {
+    ProfileScope profileCull{mProfiler, "cull"};
+    for (const auto& group : particles) {
+      auto& buffers = groupBuffers(group.spawner);
+      buffers.used = true;
+      releaseStreams(buffers);
+      cull(group);
+    }
+  }
+  std::size_t total = 0;
+  for (const auto& run : mVisibleRuns) {
+    total += static_cast<std::size_t>(run.to - run.from);
+  }
+  // Nothing to upload or draw, the ring may not even have a buffer yet
+  if (total == 0) {
+    return;
+  }
+
+  // The visible instances are packed back to back, each run is one draw command
+  auto& ring = instances();
+  {
+    ProfileScope profileUpload{mProfiler, "instance upload"};
+    const auto segment = ring.map(total);
+    // The frame is skipped if the ring could not be mapped
+    if (!segment) {
+      return;
+    }
+    std::size_t offset = 0;
+    for (const auto& run : mVisibleRuns) {
+      const auto& group = *run.group;
+      auto& buffers = groupBuffers(group.spawner);
+      updateGradient(buffers, group.colorGradient, group.fadeIn);
+
+      const auto count = static_cast<std::size_t>(run.to - run.from);
+      writeInstances(mFormat, group.streams, run.from, run.to, group.origin, streamPointers(*segment, mFormat, offset));
+      buffers.uploadedBytes += count * instanceSize(mFormat);
+      addDraw(nullptr, group.origin, buffers.gradientLayer, segment->baseInstance + static_cast<GLuint>(offset), count);
+      offset += count;
+    }
+    ring.unmap();
+  }
+  mUploadedBytes = total * instanceSize(mFormat);
+
+  StreamBinding streams;
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    streams.buffers[s] = ring.buffer();
+    streams.offsets[s] = ring.offset(s, 0);
+  }
+  submitDraws(mFormat, streams);
+  ring.fence();
+}
+
+void ParticleStreamRenderer::renderAppended(const std::vector<SpawnerParticles>& particles)
+{
+  // Instance data never changes after spawn, only sequence numbers the GPU ring has not seen yet are staged
+  {
+    ProfileScope profileUpload{mProfiler, "instance upload"};
+    mAppends.clear();
+    std::size_t total = 0;
+    for (const auto& group : particles) {
+      auto& buffers = groupBuffers(group.spawner);
+      buffers.used = true;
+      const auto& streams = group.streams;
+      if (streams.capacity() == 0) {
+        continue;
+      }
+      // The ring was relocated on growth or restarted, or the format changed. The slot layout differs and everything
+      // is uploaded again, this also moves the compact anchor to the current spawner position.
+      if (buffers.capacity != streams.capacity() || buffers.format != mFormat || streams.head < buffers.uploadedHead) {
+        allocateStreams(buffers, streams.capacity());
+        buffers.uploadedHead = streams.tail;
+        buffers.anchor = group.origin;
+      }
+      const auto from = std::max(buffers.uploadedHead, streams.tail);
+      if (from < streams.head) {
+        mAppends.push_back({&group, &buffers, from, total});
+        total += static_cast<std::size_t>(streams.head - from);
+        buffers.uploadedBytes = static_cast<std::size_t>(streams.head - from) * instanceSize(mFormat);
+      }
+      buffers.uploadedHead = streams.head;
+    }
+
+    if (total > 0) {
+      auto& ring = instances();
+      const auto segment = ring.map(total);
+      // The frame is skipped if the ring could not be mapped, the particles are staged again by the next one
+      if (!segment) {
+        for (const auto& append : mAppends) {
+          append.buffers->uploadedHead = append.from;
+        }
+        return;
+      }
+      for (const auto& append : mAppends) {
+        const auto& streams = append.group->streams;
+        writeInstances(mFormat, streams, append.from, streams.head, append.buffers->anchor,
+                       streamPointers(*segment, mFormat, append.offset));
+      }
+      ring.unmap();
+      mUploadedBytes = total * instanceSize(mFormat);
+
+      // GPU side copies into the ring slots, ordered after the draws of earlier frames without a CPU wait
+      const auto sizes = instanceStreamSizes(mFormat);
+      glBindBuffer(GL_COPY_READ_BUFFER, ring.buffer());
+      for (const auto& append : mAppends) {
+        auto instance = segment->baseInstance + append.offset;
+        for (const auto& range : append.group->streams.ranges(append.from, append.group->streams.head)) {
+          if (range.count == 0) {
+            continue;
+          }
+          for (std::size_t s = 0; s < maxInstanceStreams && sizes[s] > 0; s++) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, append.buffers->streams[s]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ring.offset(s, instance),
+                                static_cast<GLintptr>(range.first * sizes[s]),
+                                static_cast<GLsizeiptr>(range.count * sizes[s]));
+          }
+          instance += range.count;
+        }
+      }
+      ring.fence();
+    }
+  }
+
+  // Dead particles are skipped by drawing from the tail, the GPU ring mirrors the slots of the simulation's ring.
+  // Culled particles are still uploaded, they are drawn as soon as they come into view.
+  mVisibleRuns.clear();
+  {
+    ProfileScope profileCull{mProfiler, "cull"};
+    for (const auto& group : particles) {
+      cull(group);
+    }
+  }
+  for (const auto& run : mVisibleRuns) {
+    const auto& group = *run.group;
+    auto& buffers = groupBuffers(group.spawner);
+    updateGradient(buffers, group.colorGradient, group.fadeIn);
+    for (const auto& range : group.streams.ranges(run.from, run.to)) {
+      addDraw(&buffers.streams, buffers.anchor, buffers.gradientLayer, static_cast<GLuint>(range.first), range.count);
+    }
+  }
+  submitDraws(mFormat, {});
+}
+
+void ParticleStreamRenderer::addDraw(const std::array<GLuint, maxInstanceStreams>* streams, const aw::Vec3& anchor,
+                                     std::size_t gradientLayer, GLuint baseInstance, std::size_t count)
+{
+  if (count == 0) {
+    return;
+  }
+  mCommands.push_back({4, static_cast<GLuint>(count), 0, baseInstance});
+  mDrawParameters.push_back({anchor, gradientIndex(gradientLayer)});
+  mSpriteFirsts.push_back(static_cast<GLuint>(mSpriteCount));
+  mSpriteCount += count;
+  addBatch(streams, gradientWindow(gradientLayer), mCommands.size() - 1, 1, count);
+}
+
+void ParticleStreamRenderer::addBatch(const std::array<GLuint, maxInstanceStreams>* streams,
+                                      std::size_t gradientWindow, std::size_t firstCommand, std::size_t commandCount,
+                                      std::size_t maxInstances)
+{
+  if (!mBatches.empty()) {
+    auto& last = mBatches.back();
+    if (last.streams == streams && last.gradientWindow == gradientWindow &&
+        last.firstCommand + last.commandCount == firstCommand) {
+      last.commandCount += commandCount;
+      last.maxInstances = std::max(last.maxInstances, maxInstances);
+      return;
+    }
+  }
+  mBatches.push_back({streams, gradientWindow, firstCommand, commandCount, maxInstances});
+}
+
+void ParticleStreamRenderer::submitDraws(InstanceFormat format, const StreamBinding& streams, GLuint commandBuffer)
+{
+  ProfileScope profileDraw{mProfiler, "particle draw"};
+  glBindBuffer(GL_TEXTURE_BUFFER, mDrawParameterBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(mDrawParameters.size() * sizeof(DrawParameters)),
+               mDrawParameters.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  if (pullQuads()) {
+    submitSprites(format, streams, commandBuffer);
+    return;
+  }
+
+  // Commands written on the GPU can only be drawn indirectly, their counts are not known here. Without draw ids a
+  // multi draw could not tell its commands apart.
+  const auto multiDraw = mDrawIds && glExt::hasMultiDrawIndirect();
+  const auto indirect = commandBuffer != 0 || (mSubmission == DrawSubmission::Indirect && multiDraw);
+  if (indirect) {
+    if (commandBuffer == 0) {
+      commandBuffer = mCommandBuffer;
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLsizeiptr>(mCommands.size() * sizeof(DrawCommand)),
+                   mCommands.data(), GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+  }
+
+  const auto& program = mPrograms[static_cast<std::size_t>(format)];
+  bindStreams(format, streams);
+  for (const auto& batch : mBatches) {
+    if (batch.streams) {
+      bindStreams(format, {*batch.streams, {}});
+    }
+    if (analyticGradients) {
+      const auto windowBytes = mGradientWindowSize * sizeof(GradientBlock);
+      glBindBufferRange(GL_UNIFORM_BUFFER, 0, mGradients, static_cast<GLintptr>(batch.gradientWindow * windowBytes),
+                        static_cast<GLsizeiptr>(windowBytes));
+    }
+    if (indirect && multiDraw) {
+      const auto offset = batch.firstCommand * sizeof(DrawCommand);
+      glUniform1i(program.firstDraw, static_cast<GLint>(batch.firstCommand));
+      glExt::multiDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<const void*>(offset),
+                                     static_cast<GLsizei>(batch.commandCount), 0);
+      mDrawCalls++;
+      continue;
+    }
+    for (auto c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; c++) {
+      glUniform1i(program.firstDraw, static_cast<GLint>(c));
+      if (indirect) {
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<const void*>(c * sizeof(DrawCommand)));
+      } else {
+        const auto& command = mCommands[c];
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, static_cast<GLint>(command.first),
+                                          static_cast<GLsizei>(command.count),
+                                          static_cast<GLsizei>(command.instanceCount), command.baseInstance);
+      }
+      mDrawCalls++;
+    }
+  }
+  if (indirect) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+}
+
+auto ParticleStreamRenderer::pullQuads() const -> bool
+{
+  return mExpansion == QuadExpansion::Pulled && mSpritesSupported && mSpriteCount <= mMaxSprites;
+}
+
+void ParticleStreamRenderer::submitSprites(InstanceFormat format, const StreamBinding& streams, GLuint commandBuffer)
+{
+  if (mSpriteCount == 0) {
+    return;
+  }
+  reserveSprites(mSpriteCount);
+  // Pool slots outside the ring ranges of GPU written commands are not visited, they stay degenerate sprites. CPU
+  // commands cover every sprite of the frame.
+  if (commandBuffer != 0) {
+    const float zero = 0.f;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSprites);
+    glExt::clearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32F, 0,
+                              static_cast<GLsizeiptr>(mSpriteCount * spriteSize), GL_RED, GL_FLOAT, &zero);
+  } else {
+    commandBuffer = mCommandBuffer;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(mCommands.size() * sizeof(DrawCommand)),
+                 mCommands.data(), GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSpriteFirstBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(mSpriteFirsts.size() * sizeof(GLuint)),
+               mSpriteFirsts.data(), GL_STREAM_DRAW);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commandsBinding, commandBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, spritesBinding, mSprites);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, spriteFirstsBinding, mSpriteFirstBuffer);
+
+  const auto& program = mSpritePrograms[static_cast<std::size_t>(format)];
+  glUseProgram(program.id);
+  glUniformMatrix4fv(program.viewProjection, 1, GL_FALSE, &mViewProjection[0][0]);
+  glUniform1f(program.simulationTime, mSimulationTime);
+  glUniform1i(program.colorGradient, 0);
+  glUniform1i(program.drawParameters, 1);
+  glUniform2f(program.pixelsPerUnit, mCullView.pixelsPerUnit.x, mCullView.pixelsPerUnit.y);
+  glUniform1f(program.minPixelSize, mCullView.minPixelSize);
+
+  const auto sizes = instanceStreamSizes(format);
+  const auto alignment = static_cast<GLintptr>(mStorageAlignment);
+  for (const auto& batch : mBatches) {
+    const auto batchStreams = batch.streams ? StreamBinding{*batch.streams, {}} : streams;
+    // Storage buffers are bound at aligned offsets, the shader skips the elements before instance 0
+    std::array<GLuint, maxInstanceStreams> streamFirst{};
+    for (std::size_t s = 0; s < maxInstanceStreams && sizes[s] > 0; s++) {
+      const auto buffer = batchStreams.buffers[s];
+      const auto offset = batchStreams.offsets[s];
+      const auto aligned = offset - offset % alignment;
+      if (aligned == 0) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(s), buffer);
+      } else {
+        GLint bufferSize = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &bufferSize);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(s), buffer, aligned, bufferSize - aligned);
+      }
+      streamFirst[s] = static_cast<GLuint>(static_cast<std::size_t>(offset - aligned) / sizes[s]);
+    }
+    glUniform1uiv(program.streamFirst, static_cast<GLsizei>(maxInstanceStreams), streamFirst.data());
+    if (analyticGradients) {
+      const auto windowBytes = mGradientWindowSize * sizeof(GradientBlock);
+      glBindBufferRange(GL_UNIFORM_BUFFER, 0, mGradients, static_cast<GLintptr>(batch.gradientWindow * windowBytes),
+                        static_cast<GLsizeiptr>(windowBytes));
+    }
+
+    // Work group row y evaluates command firstCommand + y
+    const auto instanceGroups = (batch.maxInstances + spriteGroupSize - 1) / spriteGroupSize;
+    for (std::size_t y = 0; y < batch.commandCount; y += maxWorkGroups) {
+      glUniform1ui(program.firstCommand, static_cast<GLuint>(batch.firstCommand + y));
+      const auto rows = std::min<std::size_t>(batch.commandCount - y, maxWorkGroups);
+      for (std::size_t x = 0; x < instanceGroups; x += maxWorkGroups) {
+        glUniform1ui(program.firstInstance, static_cast<GLuint>(x * spriteGroupSize));
+        glExt::dispatchCompute(static_cast<GLuint>(std::min<std::size_t>(instanceGroups - x, maxWorkGroups)),
+                               static_cast<GLuint>(rows), 1);
+      }
+    }
+  }
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+  glUseProgram(mSpriteDrawProgram);
+  glUniform1i(mSpriteSampler, 2);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, mSpriteTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glBindVertexArray(mSpriteVao);
+  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mSpriteCount * 6), GL_UNSIGNED_INT, nullptr);
+  mDrawCalls++;
+  glBindVertexArray(mVao);
+  glUseProgram(mPrograms[static_cast<std::size_t>(format)].id);
+}
+
+void ParticleStreamRenderer::reserveSprites(std::size_t count)
+{
+  if (count <= mSpriteCapacity) {
+    return;
+  }
+  auto capacity = std::max(mSpriteCapacity, minSpriteCapacity);
+  while (capacity < count) {
+    capacity *= 2;
+  }
+  mSpriteCapacity = capacity;
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSprites);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(capacity * spriteSize), nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  // Corners 0, 1, 2, 3 of a sprite are (-x, -y), (x, -y), (-x, y), (x, y)
+  std::vector<GLuint> indices(capacity * 6);
+  for (std::size_t i = 0; i < capacity; i++) {
+    const auto corner = static_cast<GLuint>(i * 4);
+    const std::array<GLuint, 6> quad = {corner, corner + 1, corner + 2, corner + 2, corner + 1, corner + 3};
+    std::copy(quad.begin(), quad.end(), indices.begin() + static_cast<std::ptrdiff_t>(i * 6));
+  }
+  glBindVertexArray(mSpriteVao);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mSpriteIndices);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(GLuint)), indices.data(),
+               GL_STATIC_DRAW);
+  glBindVertexArray(mVao);
+}
+
+auto ParticleStreamRenderer::instances() -> InstanceRing&
+{
+  return mFormat == InstanceFormat::Float ? mFloatInstances : mCompactInstances;
+}
+
+void ParticleStreamRenderer::bindStreams(InstanceFormat format, const StreamBinding& streams)
+{
+  const auto& attributes = instanceAttributes[static_cast<std::size_t>(format)];
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    if (attributes[s].components == 0) {
+      glDisableVertexAttribArray(attributeLocation(s));
+      continue;
+    }
+    glEnableVertexAttribArray(attributeLocation(s));
+    glBindBuffer(GL_ARRAY_BUFFER, streams.buffers[s]);
+    glVertexAttribPointer(attributeLocation(s), attributes[s].components, attributes[s].type, GL_FALSE, 0,
+                          reinterpret_cast<void*>(static_cast<std::uintptr_t>(streams.offsets[s])));
+  }
+}
+
+void ParticleStreamRenderer::allocateStreams(GroupBuffers& buffers, std::size_t capacity)
+{
+  if (buffers.streams[0] == 0) {
+    glGenBuffers(static_cast<GLsizei>(maxInstanceStreams), buffers.streams.data());
+  }
+  const auto sizes = instanceStreamSizes(mFormat);
+  for (std::size_t s = 0; s < maxInstanceStreams; s++) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.streams[s]);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizes[s]), nullptr, GL_DYNAMIC_DRAW);
+  }
+  buffers.capacity = capacity;
+  buffers.format = mFormat;
+}
+
+void ParticleStreamRenderer::releaseStreams(GroupBuffers& buffers)
+{
+  if (buffers.streams[0] != 0) {
+    glDeleteBuffers(static_cast<GLsizei>(maxInstanceStreams), buffers.streams.data());
+  }
+  buffers.streams = {};
+  buffers.capacity = 0;
+  buffers.uploadedHead = 0;
+}
+
+auto ParticleStreamRenderer::groupBuffers(entt::entity spawner) -> GroupBuffers&
+{
+  auto [it, inserted] = mGroups.try_emplace(spawner);
+  if (inserted) {
+    if (!mFreeGradientLayers.empty()) {
+      it->second.gradientLayer = mFreeGradientLayers.back();
+      mFreeGradientLayers.pop_back();
+    } else {
+      if (mUsedGradientLayers == mGradientLayers) {
+        growGradients(mGradientLayers * 2);
+      }
+      it->second.gradientLayer = mUsedGradientLayers++;
+    }
+  }
+  return it->second;
+}
+
+void ParticleStreamRenderer::growGradients(std::size_t layers)
+{
+  mGradientLayers = layers;
+  if (analyticGradients) {
+    // Whole windows, the last one is bound with its full size
+    const auto windows = (layers + mGradientWindowSize - 1) / mGradientWindowSize;
+    mGradientBlocks.resize(windows * mGradientWindowSize);
+    glBindBuffer(GL_UNIFORM_BUFFER, mGradients);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(mGradientBlocks.size() * sizeof(GradientBlock)),
+                 mGradientBlocks.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_1D_ARRAY, mGradients);
+  glTexImage2D(GL_TEXTURE_1D_ARRAY, 0, GL_RGBA8, gradientResolution, static_cast<GLsizei>(layers), 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  for (auto& [spawner, buffers] : mGroups) {
+    // Groups which never uploaded a gradient have no layer yet
+    if (buffers.fadeIn < 0.f) {
+      continue;
+    }
+    const auto colorGradient = buffers.colorGradient;
+    const auto fadeIn = buffers.fadeIn;
+    buffers.fadeIn = -1.f;
+    updateGradient(buffers, colorGradient, fadeIn);
+  }
+}
+
+void ParticleStreamRenderer::updateGradient(GroupBuffers& buffers, const ColorGradient& colorGradient, float fadeIn)
+{
+  if (buffers.fadeIn == fadeIn && std::memcmp(&buffers.colorGradient, &colorGradient, sizeof(colorGradient)) == 0) {
+    return;
+  }
+  buffers.colorGradient = colorGradient;
+  buffers.fadeIn = fadeIn;
+
+  if (analyticGradients) {
+    auto& block = mGradientBlocks[buffers.gradientLayer];
+    block.stops = colorGradient;
+    block.fadeIn = fadeIn;
+    glBindBuffer(GL_UNIFORM_BUFFER, mGradients);
+    glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(buffers.gradientLayer * sizeof(GradientBlock)),
+                    sizeof(GradientBlock), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return;
+  }
+
+  // The gradient is sampled with the elapsed life fraction, the fade in ramps up alpha at its start. The stops are
+  // evenly spaced and interpolated like gradientColor in particleShading.glsl does for the analytic gradients.
+  constexpr auto stops = std::tuple_size_v<ColorGradient>;
+  std::array<std::uint8_t, gradientResolution * 4> texels{};
+  for (GLsizei i = 0; i < gradientResolution; i++) {
+    const auto t = static_cast<float>(i) / static_cast<float>(gradientResolution - 1);
+    const auto fade = fadeIn > 0.f ? std::min(t / fadeIn, 1.f) : 1.f;
+    const auto x = t * static_cast<float>(stops - 1);
+    const auto stop = std::min(static_cast<std::size_t>(x), stops - 2);
+    const auto fraction = x - static_cast<float>(stop);
+    const float* begin = &colorGradient[stop].r;
+    const float* end = &colorGradient[stop + 1].r;
+    for (int c = 0; c < 4; c++) {
+      auto value = begin[c] + (end[c] - begin[c]) * fraction;
+      value = c == 3 ? value * fade : value;
+      texels[static_cast<std::size_t>(i * 4 + c)] = static_cast<std::uint8_t>(std::clamp(value, 0.f, 1.f) * 255.f);
+    }
+  }
+  glBindTexture(GL_TEXTURE_1D_ARRAY, mGradients);
+  glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, static_cast<GLint>(buffers.gradientLayer), gradientResolution, 1, GL_RGBA,
+                  GL_UNSIGNED_BYTE, texels.data());
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "aw/graphics/opengl/gl.hpp"
+#include "aw/util/filesystem/fileStream.hpp"
+#include "aw/util/math/vector.hpp"
+#include "particleSystem/bounds.hpp"
+#include "particleSystem/gpuSimulation.hpp"
+#include "particleSystem/instanceRing.hpp"
+#include "particleSystem/simulation.hpp"
+#include "profiler.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// How particle instances reach the GPU
+enum class InstanceUpload
+{
+  // All resident particles are packed into the InstanceRing every frame, O(live) upload
+  Repack,
+  // Every spawner has GPU buffers mirroring the slots of its simulation ring. Particles are immutable after spawn, so
+  // only the ones spawned since the last frame are staged in the InstanceRing and copied into their slots on the GPU,
+  // O(spawned) upload. Expired particles are skipped by drawing from the ring tail.
+  Append,
+};
+
+// How the draws of a frame reach the GPU
+enum class DrawSubmission
+{
+  // One glDrawArraysInstancedBaseInstance per spawner and ring range
+  Direct,
+  // The instance counts and base instances of all draws are uploaded into one indirect buffer, every run of draws
+  // sharing the same instance streams is a single glMultiDrawArraysIndirect (GL 4.3 and ARB_shader_draw_parameters).
+  // Falls back to Direct without them.
+  Indirect,
+};
+
+// How the four corners of a particle quad are computed
+enum class QuadExpansion
+{
+  // particle.vert evaluates the whole particle (lifetime, gradient, movement, size and rotation) once per corner
+  Instanced,
+  // particleSprites.comp evaluates every particle once into a clip space sprite, particleSprite.vert pulls the corners
+  // of sprite gl_VertexID / 4 from the sprite buffer in a single indexed draw. Needs compute shaders (GL 4.3), falls
+  // back to Instanced without them or if the sprites exceed GL_MAX_TEXTURE_BUFFER_SIZE.
+  Pulled,
+};
+
+// Draws the particles of a ParticleSimulation, one instanced draw per spawner and ring range.
+// Instances are uploaded in one of the InstanceFormat layouts, each has its own variant of particle.vert.
+// A GpuParticleSimulation is drawn from its own pool with the indirect draws it wrote, always in the float format.
+//
+// Every spawner owns a gradient layer. Gradients with few stops are evaluated analytically in particle.vert from a
+// uniform buffer, bound in windows of as many gradients as one uniform block holds, longer ones are baked into a
+// texture array. The gradient layer and compact anchor of every draw command are looked up in a buffer texture by
+// draw id, so draws of different spawners only split where the instance streams or the gradient window change:
+// repacked and GPU simulated particles are a single multi draw per window, appended ones one per spawner.
+// With pulled quads the draw commands are instead dispatched as a compute prepass, per batch like the draws.
+//
+// With culling, spawners whose particle bounds are outside the view or below the minimum pixel size are not drawn.
+// Spawners crossing the view edge are culled per bounds chunk of their ring, the shaders drop sub-pixel particles.
+class ParticleStreamRenderer
+{
+public:
+  ParticleStreamRenderer(const aw::fs::path& shaderDirectory);
+  ~ParticleStreamRenderer();
+
+  ParticleStreamRenderer(const ParticleStreamRenderer&) = delete;
+  auto operator=(const ParticleStreamRenderer&) -> ParticleStreamRenderer& = delete;
+
+  void render(const aw::Mat4& viewProjection, float simulationTime, const std::vector<SpawnerParticles>& particles);
+  // timeAhead is added to the simulation time, see FixedStepClock::interpolation
+  void render(const aw::Mat4& viewProjection, const GpuParticleSimulation& simulation, float timeAhead = 0.f);
+
+  auto instanceUpload() const -> InstanceUpload { return mUpload; }
+  void setInstanceUpload(InstanceUpload upload) { mUpload = upload; }
+
+  auto instanceFormat() const -> InstanceFormat { return mFormat; }
+  void setInstanceFormat(InstanceFormat format) { mFormat = format; }
+
+  auto drawSubmission() const -> DrawSubmission { return mSubmission; }
+  void setDrawSubmission(DrawSubmission submission) { mSubmission = submission; }
+
+  auto quadExpansion() const -> QuadExpansion { return mExpansion; }
+  void setQuadExpansion(QuadExpansion expansion) { mExpansion = expansion; }
+  // False if the context lacks the features of QuadExpansion::Pulled or its shaders failed to compile
+  auto pulledQuadsSupported() const -> bool { return mSpritesSupported; }
+
+  auto culling() const -> bool { return mCulling; }
+  void setCulling(bool culling) { mCulling = culling; }
+  // Particles whose quads stay below this many pixels on screen are culled
+  auto minPixelSize() const -> float { return mMinPixelSize; }
+  void setMinPixelSize(float pixels) { mMinPixelSize = pixels; }
+
+  // Records the CPU side "particle render" stage and its "cull", "instance upload" and "particle draw" parts, nullptr
+  // disables profiling
+  void setProfiler(Profiler* profiler) { mProfiler = profiler; }
+
+  // Particles skipped by the bounds tests of the last rendered frame, without the ones the shaders drop as sub-pixel
+  auto culledParticles() const -> std::size_t { return mCulledParticles; }
+  // View the last frame was culled against
+  auto cullView() const -> const CullView& { return mCullView; }
+  // Instance bytes written for the last rendered frame
+  auto uploadedBytes() const -> std::size_t { return mUploadedBytes; }
+  // Of the spawner's particles, GPU simulated particles are not uploaded
+  auto uploadedBytes(entt::entity spawner) const -> std::size_t;
+  // Draw calls issued for the last rendered frame
+  auto drawCalls() const -> std::size_t { return mDrawCalls; }
+
+private:
+  using ColorGradient = decltype(aw::ParticleSpawner::colorGradient);
+
+  static constexpr std::size_t maxAnalyticGradientStops = 4;
+  // Selected by the stop count of the spawner's gradient type
+  static constexpr bool analyticGradients = std::tuple_size_v<ColorGradient> <= maxAnalyticGradientStops;
+
+  // std140 layout of Gradient in particle.vert
+  struct GradientBlock
+  {
+    ColorGradient stops;
+    float fadeIn;
+    std::array<float, 3> padding;
+  };
+  static_assert(sizeof(GradientBlock) == (std::tuple_size_v<ColorGradient> + 1) * 4 * sizeof(float));
+
+  struct Program
+  {
+    GLuint id{0};
+    GLint viewProjection{-1};
+    GLint simulationTime{-1};
+    GLint colorGradient{-1};
+    GLint drawParameters{-1};
+    GLint firstDraw{-1};
+    GLint pixelsPerUnit{-1};
+    GLint minPixelSize{-1};
+  };
+
+  struct SpriteProgram
+  {
+    GLuint id{0};
+    GLint viewProjection{-1};
+    GLint simulationTime{-1};
+    GLint colorGradient{-1};
+    GLint drawParameters{-1};
+    GLint streamFirst{-1};
+    GLint firstCommand{-1};
+    GLint firstInstance{-1};
+    GLint pixelsPerUnit{-1};
+    GLint minPixelSize{-1};
+  };
+
+  // Instance stream buffers and the byte offsets of instance 0
+  struct StreamBinding
+  {
+    std::array<GLuint, maxInstanceStreams> buffers{};
+    std::array<GLintptr, maxInstanceStreams> offsets{};
+  };
+
+  struct GroupBuffers
+  {
+    // Append mode only, same capacity and slot layout as the spawner's ParticleStreams
+    std::array<GLuint, maxInstanceStreams> streams{};
+    std::size_t capacity{0};
+    InstanceFormat format{InstanceFormat::Float};
+    std::uint64_t uploadedHead{0};
+    // Compact positions are stored relative to this point
+    aw::Vec3 anchor{0.f, 0.f, 0.f};
+
+    std::size_t gradientLayer{0};
+    ColorGradient colorGradient{};
+    float fadeIn{-1.f};
+    bool used{false};
+    // Instance bytes written in the last rendered frame
+    std::size_t uploadedBytes{0};
+  };
+
+  // Binds the program of the format, returns false if it failed to compile
+  auto beginFrame(InstanceFormat format, const aw::Mat4& viewProjection, float simulationTime) -> bool;
+  void endFrame();
+
+  // Appends the ring ranges of the group that are not culled to mVisibleRuns
+  void cull(const SpawnerParticles& group);
+  auto visible(const ParticleBounds& bounds) const -> Visibility;
+
+  void renderRepacked(const std::vector<SpawnerParticles>& particles);
+  void renderAppended(const std::vector<SpawnerParticles>& particles);
+
+  auto instances() -> InstanceRing&;
+  // Points the instance attributes of the format at the given buffers and byte offsets
+  void bindStreams(InstanceFormat format, const StreamBinding& streams);
+
+  void allocateStreams(GroupBuffers& buffers, std::size_t capacity);
+  void releaseStreams(GroupBuffers& buffers);
+
+  auto groupBuffers(entt::entity spawner) -> GroupBuffers&;
+  // Reallocating the texture array drops its contents, the uploaded gradients are uploaded again
+  void growGradients(std::size_t layers);
+  // Gradient window of a layer and the layer's index in it
+  auto gradientWindow(std::size_t layer) const -> std::size_t { return layer / mGradientWindowSize; }
+  auto gradientIndex(std::size_t layer) const -> float { return static_cast<float>(layer % mGradientWindowSize); }
+  void updateGradient(GroupBuffers& buffers, const ColorGradient& colorGradient, float fadeIn);
+
+  // Layout of GL's DrawArraysIndirectCommand
+  struct DrawCommand
+  {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+  };
+
+  // Texel of the draw parameter buffer texture, one per draw command
+  struct DrawParameters
+  {
+    aw::Vec3 anchor;
+    // See gradientIndex
+    float gradient;
+  };
+  static_assert(sizeof(DrawParameters) == 4 * sizeof(float));
+
+  struct DrawBatch
+  {
+    // Instance streams at offset 0, nullptr uses the streams passed to submitDraws
+    const std::array<GLuint, maxInstanceStreams>* streams;
+    std::size_t gradientWindow;
+    std::size_t firstCommand;
+    std::size_t commandCount;
+    // Upper bound of the instance count of every command, sizes the prepass dispatch
+    std::size_t maxInstances;
+  };
+
+  // Also assigns the next count sprites to the draw
+  void addDraw(const std::array<GLuint, maxInstanceStreams>* streams, const aw::Vec3& anchor,
+               std::size_t gradientLayer, GLuint baseInstance, std::size_t count);
+  // Commands [firstCommand, firstCommand + commandCount), merged into the last batch if it continues it
+  void addBatch(const std::array<GLuint, maxInstanceStreams>* streams, std::size_t gradientWindow,
+                std::size_t firstCommand, std::size_t commandCount, std::size_t maxInstances);
+  // Issues the batches with mDrawParameters, the commands come from mCommands or from commandBuffer if it is not 0
+  void submitDraws(InstanceFormat format, const StreamBinding& streams, GLuint commandBuffer = 0);
+
+  auto pullQuads() const -> bool;
+  // Runs the sprite prepass over the batches and draws the mSpriteCount sprites
+  void submitSprites(InstanceFormat format, const StreamBinding& streams, GLuint commandBuffer);
+  void reserveSprites(std::size_t count);
+
+  struct Append
+  {
+    const SpawnerParticles* group;
+    GroupBuffers* buffers;
+    std::uint64_t from;
+    // Instance offset in the staged segment
+    std::size_t offset;
+  };
+
+  // Particles [from, to) of a group's ring that are drawn
+  struct VisibleRun
+  {
+    const SpawnerParticles* group;
+    std::uint64_t from;
+    std::uint64_t to;
+  };
+
+private:
+  // Indexed by InstanceFormat
+  std::array<Program, 2> mPrograms;
+
+  GLuint mVao{0};
+  GLuint mQuadBuffer{0};
+  InstanceRing mFloatInstances{InstanceFormat::Float};
+  InstanceRing mCompactInstances{InstanceFormat::Compact};
+  InstanceUpload mUpload{InstanceUpload::Append};
+  InstanceFormat mFormat{InstanceFormat::Float};
+  DrawSubmission mSubmission{DrawSubmission::Indirect};
+  QuadExpansion mExpansion{QuadExpansion::Instanced};
+  std::size_t mUploadedBytes{0};
+  std::size_t mDrawCalls{0};
+  Profiler* mProfiler{nullptr};
+
+  bool mCulling{true};
+  float mMinPixelSize{0.5f};
+  std::size_t mCulledParticles{0};
+  CullView mCullView;
+  std::vector<VisibleRun> mVisibleRuns;
+
+  std::unordered_map<entt::entity, GroupBuffers> mGroups;
+  std::vector<Append> mAppends;
+
+  // Layer capacity of the gradients, layers of released spawners are reused first. mGradients is the uniform buffer of
+  // GradientBlocks (mirrored in mGradientBlocks) or the texture array.
+  GLuint mGradients{0};
+  std::vector<GradientBlock> mGradientBlocks;
+  std::size_t mGradientWindowSize{1};
+  std::size_t mGradientLayers{0};
+  std::size_t mUsedGradientLayers{0};
+  std::vector<std::size_t> mFreeGradientLayers;
+
+  // gl_DrawIDARB is available, otherwise every command is its own draw call
+  bool mDrawIds{false};
+  std::vector<DrawCommand> mCommands;
+  std::vector<DrawParameters> mDrawParameters;
+  std::vector<DrawBatch> mBatches;
+  GLuint mCommandBuffer{0};
+  GLuint mDrawParameterBuffer{0};
+  GLuint mDrawParameterTexture{0};
+
+  // Pulled quads, indexed by InstanceFormat. Sprite capacity of mSprites and of the quad indices in mSpriteIndices.
+  std::array<SpriteProgram, 2> mSpritePrograms;
+  GLuint mSpriteDrawProgram{0};
+  GLint mSpriteSampler{-1};
+  bool mSpritesSupported{false};
+  GLint mStorageAlignment{1};
+  std::size_t mMaxSprites{0};
+  GLuint mSpriteVao{0};
+  GLuint mSprites{0};
+  GLuint mSpriteTexture{0};
+  GLuint mSpriteIndices{0};
+  GLuint mSpriteFirstBuffer{0};
+  std::size_t mSpriteCapacity{0};
+  // First sprite of every command, the sprites of the frame
+  std::vector<GLuint> mSpriteFirsts;
+  std::size_t mSpriteCount{0};
+  aw::Mat4 mViewProjection;
+  float mSimulationTime{0.f};
+};
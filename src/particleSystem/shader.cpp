@@ -0,0 +1,98 @@
+#include "particleSystem/shader.hpp"
+
+#include "aw/util/log.hpp"
+#include "glExt.hpp"
+
+#include <array>
+#include <fstream>
+#include <sstream>
+
+namespace {
+constexpr const char* glslVersion = "#version 430 core\n";
+
+auto readFile(const aw::fs::path& path, std::string& content) -> bool
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  content = buffer.str();
+  return true;
+}
+
+auto compileShader(GLenum type, const std::vector<aw::fs::path>& paths, const std::string& defines) -> GLuint
+{
+  std::vector<std::string> files(paths.size());
+  std::vector<const char*> sources = {glslVersion, defines.c_str()};
+  for (std::size_t i = 0; i < paths.size(); i++) {
+    if (!readFile(paths[i], files[i])) {
+      APP_ERROR("Could not read shader: {}", paths[i].string());
+      return 0;
+    }
+    sources.push_back(files[i].c_str());
+  }
+
+  auto shader = glCreateShader(type);
+  glShaderSource(shader, static_cast<GLsizei>(sources.size()), sources.data(), nullptr);
+  glCompileShader(shader);
+
+  GLint status = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE) {
+    std::array<char, 2048> log{};
+    glGetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), nullptr, log.data());
+    APP_ERROR("Failed to compile {}: {}", paths.back().string(), log.data());
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+// Links the shaders and deletes them, name is only used for the error log
+auto linkProgram(const std::vector<GLuint>& shaders, const std::string& name) -> GLuint
+{
+  auto program = glCreateProgram();
+  for (auto shader : shaders) {
+    glAttachShader(program, shader);
+  }
+  glLinkProgram(program);
+  for (auto shader : shaders) {
+    glDeleteShader(shader);
+  }
+
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    std::array<char, 2048> log{};
+    glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+    APP_ERROR("Failed to link {}: {}", name, log.data());
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+} // namespace
+
+auto loadShaderProgram(const std::vector<aw::fs::path>& vertexShader, const aw::fs::path& fragmentShader,
+                       const std::string& defines) -> GLuint
+{
+  auto vertex = compileShader(GL_VERTEX_SHADER, vertexShader, defines);
+  auto fragment = compileShader(GL_FRAGMENT_SHADER, {fragmentShader}, defines);
+  if (vertex == 0 || fragment == 0) {
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return 0;
+  }
+  return linkProgram({vertex, fragment}, vertexShader.back().string() + " and " + fragmentShader.string());
+}
+
+auto loadComputeProgram(const std::vector<aw::fs::path>& sources, const std::string& defines) -> GLuint
+{
+  auto compute = compileShader(GL_COMPUTE_SHADER, sources, defines);
+  if (compute == 0) {
+    return 0;
+  }
+  return linkProgram({compute}, sources.back().string());
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "aw/graphics/opengl/gl.hpp"
+#include "aw/util/filesystem/fileStream.hpp"
+
+#include <string>
+#include <vector>
+
+// Compiles and links a program from the given shader files. The GLSL version line and the optional defines are
+// prepended to every stage, the vertex shader files are concatenated in order (declarations shared by several programs
+// come first). Returns 0 and logs the info log if any step fails.
+auto loadShaderProgram(const std::vector<aw::fs::path>& vertexShader, const aw::fs::path& fragmentShader,
+                       const std::string& defines = {}) -> GLuint;
+
+// Compiles and links a compute program, the files are concatenated in order after the GLSL version line and the
+// optional defines
+auto loadComputeProgram(const std::vector<aw::fs::path>& sources, const std::string& defines = {}) -> GLuint;
@@ -0,0 +1,25 @@
+#pragma once
+
+// Instruction set detection for the translation units with hand written SIMD paths (kernels.cpp, philox.cpp).
+// x86 variants are compiled with per function target attributes and picked at runtime through kernels::activeIsa().
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AW_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AW_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(AW_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AW_TARGET(isa) __attribute__((target(isa)))
+#else
+#define AW_TARGET(isa)
+#endif
+
+#if defined(AW_KERNELS_X86) && defined(_MSC_VER) && !defined(__clang__)
+#define __builtin_ctz(x) _tzcnt_u32(x)
+#endif
@@ -0,0 +1,479 @@
+#include "particleSystem/simulation.hpp"
+
+#include "aw/util/math/transform.hpp"
+#include "particleSystem/kernels.hpp"
+#include "particleSystem/philox.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+namespace {
+// Spawners per scheduling job, scheduling a spawner without bursts is only a few instructions
+constexpr std::size_t scheduleGrain = 64;
+
+// Particles whose random words are generated together, the words are kept on the stack
+constexpr std::size_t fillBatchSize = 64;
+
+// Every particle property takes exactly one random word, two philox blocks per particle
+constexpr std::uint32_t particleBlocks = SpawnerSampler::ParticlePropertyCount / 4;
+static_assert(SpawnerSampler::ParticlePropertyCount % 4 == 0);
+
+// Step of the schedule while fast-forwarding a waking spawner
+constexpr float fastForwardStep = 1.f / 60.f;
+
+// Adds the lifetime of the scope to nanoseconds, measures nothing for nullptr
+class CostScope
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit CostScope(std::int64_t* nanoseconds) :
+      mNanoseconds{nanoseconds}, mBegin{nanoseconds ? Clock::now() : Clock::time_point{}}
+  {
+  }
+  ~CostScope()
+  {
+    if (mNanoseconds) {
+      *mNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mBegin).count();
+    }
+  }
+
+  CostScope(const CostScope&) = delete;
+  auto operator=(const CostScope&) -> CostScope& = delete;
+
+private:
+  std::int64_t* mNanoseconds;
+  Clock::time_point mBegin;
+};
+
+// Drops the bounds chunks behind the ring tail
+void retireChunks(SpawnerParticles& group)
+{
+  auto& chunks = group.chunks;
+  const auto retired = !chunks.empty() && chunks.front().end <= group.streams.tail;
+  while (!chunks.empty() && chunks.front().end <= group.streams.tail) {
+    chunks.pop_front();
+  }
+  if (retired) {
+    group.bounds = {};
+    for (const auto& chunk : chunks) {
+      group.bounds.add(chunk.bounds);
+    }
+  }
+}
+
+// Retires expired particles from the ring tail, returns those still counted by the wheel since their bucket has not
+// ended yet. The wheel has to be expired first.
+auto retireResident(SpawnerParticles& group, float time) -> std::size_t
+{
+  auto& streams = group.streams;
+  const auto from = streams.tail;
+  kernels::retire(streams, time);
+  std::size_t counted = 0;
+  for (auto sequence = from; sequence < streams.tail; sequence++) {
+    counted += group.expiry.remove(streams.aliveUntil[streams.slot(sequence)]) ? 1 : 0;
+  }
+  retireChunks(group);
+  return counted;
+}
+} // namespace
+
+auto estimatedFillArea(const SpawnerParticles& group) -> float
+{
+  // Mean of the squared size, the standard deviation of the size is a sixth of its range
+  const auto& size = group.sampler.particle[SpawnerSampler::Size];
+  const auto deviation = size.halfRange() / 3.f;
+  const auto meanSquare = size.mid() * size.mid() + deviation * deviation;
+  return static_cast<float>(group.expiry.alive()) * meanSquare * (7.f / 12.f);
+}
+
+ParticleSimulation::ParticleSimulation(entt::registry& world, JobPool& jobs, std::uint32_t seed,
+                                       std::size_t poolCapacity) :
+    mWorld{world}, mJobs{jobs}, mSeed{seed}, mPool{poolCapacity}
+{
+}
+
+void ParticleSimulation::update(aw::Seconds dt)
+{
+  ProfileScope profileUpdate{mProfiler, "simulation update"};
+  mTrace = mProfiler && mProfiler->tracing() ? mProfiler : nullptr;
+  mSimulationTime += dt.count();
+  mPool.resetCounters();
+  std::fill(mGroupTouched.begin(), mGroupTouched.end(), false);
+
+  // Creating groups changes mParticles, so it happens before any job runs
+  mActiveSpawners.clear();
+  auto view = mWorld.view<aw::Transform, aw::ParticleSpawner>();
+  for (auto entity : view) {
+    const auto origin = view.get<aw::Transform>(entity).position();
+    auto index = group(entity, origin);
+    mGroupTouched[index] = true;
+    mActiveSpawners.push_back(
+        {index, &view.get<aw::ParticleSpawner>(entity), mWorld.try_get<SpawnerLod>(entity), origin});
+  }
+
+  mJobs.parallelFor(mActiveSpawners.size(), scheduleGrain,
+                    [this, dt](std::size_t i) { prepare(mActiveSpawners[i], dt.count()); });
+
+  mRetired = 0;
+  {
+    ProfileScope profileExpiry{mProfiler, "expiry"};
+    mJobs.parallelFor(mActiveSpawners.size(), scheduleGrain, [this](std::size_t i) { expire(mActiveSpawners[i]); });
+    // Particles of removed spawners live until they expire
+    for (std::size_t i = 0; i < mParticles.size(); i++) {
+      if (!mGroupTouched[i]) {
+        auto& group = mParticles[i];
+        CostScope cost{mSpawnerCosts ? &group.cost.updateNanoseconds : nullptr};
+        group.cost.updates += mSpawnerCosts ? 1 : 0;
+        group.spawned = 0;
+        group.retired = group.expiry.expire(mSimulationTime);
+        group.retired += retireResident(group, mSimulationTime);
+        mRetired += group.retired;
+      }
+    }
+  }
+
+  {
+    ProfileScope profileSpawn{mProfiler, "spawn"};
+    mJobs.parallelFor(mActiveSpawners.size(), scheduleGrain,
+                      [this, dt](std::size_t i) { schedule(mActiveSpawners[i], dt.count()); });
+    // Rings grow in spawner order, so the pool hands out the same spans and drops the same bursts for any number of
+    // workers
+    mStats.spawned = 0;
+    for (const auto& active : mActiveSpawners) {
+      auto& group = mParticles[active.group];
+      if (!group.batches.empty()) {
+        reserveBursts(group);
+        mStats.spawned += group.spawned;
+      }
+    }
+
+    mStats.retired = mRetired;
+    mStats.live -= mStats.retired;
+    enforceBudget();
+
+    mSpawnChunks.clear();
+    for (std::size_t active = 0; active < mActiveSpawners.size(); active++) {
+      const auto& batches = mParticles[mActiveSpawners[active].group].batches;
+      for (std::size_t batch = 0; batch < batches.size(); batch++) {
+        for (std::size_t offset = 0; offset < batches[batch].count; offset += spawnChunkSize) {
+          const auto count = std::min(spawnChunkSize, batches[batch].count - offset);
+          mSpawnChunks.push_back({active, batch, batches[batch].first + offset, count});
+        }
+      }
+    }
+
+    mJobs.parallelFor(mSpawnChunks.size(), 1, [this](std::size_t i) { fill(mSpawnChunks[i]); });
+    // The fill jobs of one group run concurrently, its wheel is fed by one job afterwards
+    mCounted = 0;
+    mJobs.parallelFor(mActiveSpawners.size(), scheduleGrain,
+                      [this](std::size_t i) { countBursts(mActiveSpawners[i]); });
+    mStats.live += mCounted;
+    mStats.peakLive = std::max(mStats.peakLive, mStats.live);
+    if (mSpawnerCosts) {
+      for (const auto& chunk : mSpawnChunks) {
+        mParticles[mActiveSpawners[chunk.active].group].cost.spawnNanoseconds += chunk.nanoseconds;
+      }
+    }
+  }
+
+  // Groups of removed spawners are dropped once their particles expired
+  for (std::size_t i = 0; i < mParticles.size();) {
+    if (mGroupTouched[i] || !mParticles[i].streams.empty()) {
+      i++;
+      continue;
+    }
+    mGroupIndices.erase(mParticles[i].spawner);
+    if (i + 1 != mParticles.size()) {
+      mParticles[i] = std::move(mParticles.back());
+      mGroupTouched[i] = mGroupTouched.back();
+      mGroupIndices[mParticles[i].spawner] = i;
+    }
+    mParticles.pop_back();
+    mGroupTouched.pop_back();
+  }
+  mStats.groups = mParticles.size();
+  mStats.bytes = mPool.used() * ParticlePool::particleBytes;
+}
+
+void ParticleSimulation::setSpawnerCosts(bool enabled)
+{
+  if (enabled && !mSpawnerCosts) {
+    for (auto& group : mParticles) {
+      group.cost = {};
+    }
+  }
+  mSpawnerCosts = enabled;
+}
+
+auto ParticleSimulation::particles(entt::entity spawner) const -> const SpawnerParticles*
+{
+  auto it = mGroupIndices.find(spawner);
+  return it != mGroupIndices.end() ? &mParticles[it->second] : nullptr;
+}
+
+auto ParticleSimulation::group(entt::entity spawner, const aw::Vec3& origin) -> std::size_t
+{
+  auto it = mGroupIndices.find(spawner);
+  if (it != mGroupIndices.end()) {
+    return it->second;
+  }
+  const auto index = mParticles.size();
+  mGroupIndices.emplace(spawner, index);
+  mGroupTouched.push_back(false);
+  auto& particles = mParticles.emplace_back();
+  particles.streams = ParticleStreams{&mPool};
+  particles.spawner = spawner;
+  particles.origin = origin;
+  return index;
+}
+
+void ParticleSimulation::prepare(ActiveSpawner& active, float dt)
+{
+  auto& group = mParticles[active.group];
+  auto& spawner = *active.spawner;
+  CostScope cost{mSpawnerCosts ? &group.cost.updateNanoseconds : nullptr};
+  group.cost.updates += mSpawnerCosts ? 1 : 0;
+
+  group.colorGradient = spawner.colorGradient;
+  group.fadeIn = spawner.fadeIn;
+  group.priority = active.lod ? active.lod->priority : 0;
+  active.previousOrigin = group.origin;
+  group.origin = active.origin;
+  group.sampler.update(spawner);
+  group.batches.clear();
+  group.spawned = 0;
+  group.retired = 0;
+
+  const auto bounds = burstBounds(group.sampler, active.origin);
+  const auto detail = active.lod && mLodView ? spawnerDetail(*active.lod, *mLodView, active.origin, bounds)
+                                             : SpawnerDetail{};
+  group.amountScale = detail.amountScale;
+  // Resident particles of a sleeping group keep moving in particle.vert and are dropped there once expired. A waking
+  // group stays marked sleeping until schedule fast-forwards it.
+  active.sleeping = detail.sleeping;
+  if (detail.sleeping && !group.sleeping) {
+    group.sleeping = true;
+    group.sleptFrom = mSimulationTime - dt;
+  }
+}
+
+void ParticleSimulation::expire(const ActiveSpawner& active)
+{
+  auto& group = mParticles[active.group];
+  // Particles of a sleeping group are counted out all the same, its ring keeps them until it wakes
+  group.retired = group.expiry.expire(mSimulationTime);
+  if (!active.sleeping) {
+    ProfileScope zone{mTrace, "expire spawner", static_cast<std::uint32_t>(group.spawner)};
+    CostScope cost{mSpawnerCosts ? &group.cost.updateNanoseconds : nullptr};
+    group.retired += retireResident(group, mSimulationTime);
+  }
+  mRetired.fetch_add(group.retired, std::memory_order_relaxed);
+}
+
+void ParticleSimulation::schedule(const ActiveSpawner& active, float dt)
+{
+  if (active.sleeping) {
+    return;
+  }
+  auto& group = mParticles[active.group];
+  ProfileScope zone{mTrace, "schedule spawner", static_cast<std::uint32_t>(group.spawner)};
+  CostScope cost{mSpawnerCosts ? &group.cost.spawnNanoseconds : nullptr};
+  if (group.sleeping) {
+    group.sleeping = false;
+    fastForward(active, mSimulationTime - dt - group.sleptFrom, mSimulationTime - dt);
+  }
+
+  const philox::Key key{static_cast<std::uint32_t>(group.spawner), mSeed};
+  group.schedule.advance(group.sampler, key, dt, [&](std::size_t count, float late) {
+    spawnBurst(group, burstOrigin(active.previousOrigin, active.origin, late, dt), mSimulationTime - late, count);
+  });
+}
+
+void ParticleSimulation::fastForward(const ActiveSpawner& active, float slept, float time)
+{
+  auto& group = mParticles[active.group];
+
+  // Only bursts of the last ttl max seconds can still have resident particles, the schedule skips the older ones
+  const auto window = std::max(group.sampler.particle[SpawnerSampler::Ttl].max(), 0.f);
+  if (slept > window) {
+    group.schedule.skip(group.sampler, slept - window);
+    slept = window;
+  }
+
+  // Bursts are dated back to their due time in steps of fastForwardStep, all at the current origin
+  const philox::Key key{static_cast<std::uint32_t>(group.spawner), mSeed};
+  for (auto remaining = slept; remaining > 0.f; remaining -= fastForwardStep) {
+    const auto step = std::min(remaining, fastForwardStep);
+    const auto stepEnd = time - remaining + step;
+    group.schedule.advance(group.sampler, key, step, [&](std::size_t count, float late) {
+      spawnBurst(group, active.origin, stepEnd - late, count);
+    });
+  }
+}
+
+void ParticleSimulation::spawnBurst(SpawnerParticles& group, const aw::Vec3& origin, float time, std::size_t count)
+{
+  if (group.amountScale != 1.f) {
+    count = static_cast<std::size_t>(std::lround(static_cast<float>(count) * group.amountScale));
+  }
+  if (count > 0) {
+    group.batches.push_back({0, count, origin, time});
+  }
+}
+
+void ParticleSimulation::reserveBursts(SpawnerParticles& group)
+{
+  CostScope cost{mSpawnerCosts ? &group.cost.spawnNanoseconds : nullptr};
+  std::size_t kept = 0;
+  for (auto& batch : group.batches) {
+    const auto pushed = group.streams.push(batch.count);
+    if (!pushed) {
+      continue;
+    }
+    const auto first = *pushed;
+    batch.first = first;
+    group.batches[kept++] = batch;
+    group.spawned += batch.count;
+
+    const auto bounds = burstBounds(group.sampler, batch.origin);
+    auto& chunks = group.chunks;
+    if (chunks.empty() || chunks.back().end - chunks.back().first >= boundsChunkSize) {
+      chunks.push_back({first, first, {}});
+    }
+    chunks.back().end = first + batch.count;
+    chunks.back().bounds.add(bounds);
+    group.bounds.add(bounds);
+  }
+  group.batches.resize(kept);
+}
+
+void ParticleSimulation::fill(SpawnChunk& chunk)
+{
+  const auto& active = mActiveSpawners[chunk.active];
+  auto& group = mParticles[active.group];
+  const auto& batch = group.batches[chunk.batch];
+  ProfileScope zone{mTrace, "fill", static_cast<std::uint32_t>(group.spawner)};
+  CostScope cost{mSpawnerCosts ? &chunk.nanoseconds : nullptr};
+
+  using Sampler = SpawnerSampler;
+  const auto& sampler = group.sampler;
+  const philox::Key key{static_cast<std::uint32_t>(group.spawner), mSeed};
+  std::array<std::uint32_t, fillBatchSize * particleBlocks * 4> words;
+
+  auto& streams = group.streams;
+  for (auto first = chunk.first; first < chunk.first + chunk.count; first += fillBatchSize) {
+    const auto count = std::min<std::size_t>(fillBatchSize, chunk.first + chunk.count - first);
+    philox::fill(key, philox::Stream::Particle, first, count, particleBlocks, words.data());
+
+    // Word p * count + j belongs to property p of particle j
+    auto sample = [&](Sampler::Property property, std::size_t j) {
+      return sampler.particle[property](words[property * count + j]);
+    };
+    for (std::size_t j = 0; j < count; j++) {
+      const auto i = streams.slot(first + j);
+      aw::Vec3 offset{sample(Sampler::PositionX, j), sample(Sampler::PositionY, j), sample(Sampler::PositionZ, j)};
+      streams.positionSize[i] = aw::Vec4(batch.origin + offset, sample(Sampler::Size, j));
+      streams.rotation[i] = sample(Sampler::Rotation, j);
+      streams.velocity[i] = aw::Vec2(sample(Sampler::VelocityX, j), sample(Sampler::VelocityY, j));
+
+      const auto ttl = sample(Sampler::Ttl, j);
+      streams.aliveUntil[i] = batch.time + ttl;
+      streams.aliveFor[i] = ttl;
+    }
+  }
+}
+
+void ParticleSimulation::countBursts(const ActiveSpawner& active)
+{
+  auto& group = mParticles[active.group];
+  if (group.batches.empty()) {
+    return;
+  }
+  CostScope cost{mSpawnerCosts ? &group.cost.spawnNanoseconds : nullptr};
+  const auto& streams = group.streams;
+  // Bursts a waking group dated back beyond their ttl are not counted
+  std::size_t counted = 0;
+  for (const auto& batch : group.batches) {
+    for (auto sequence = batch.first; sequence < batch.first + batch.count; sequence++) {
+      counted += group.expiry.add(streams.aliveUntil[streams.slot(sequence)]) ? 1 : 0;
+    }
+  }
+  mCounted.fetch_add(counted, std::memory_order_relaxed);
+}
+
+void ParticleSimulation::enforceBudget()
+{
+  mStats.throttled = 0;
+  mStats.evicted = 0;
+  // This update's bursts are not counted yet, they are capped as if every particle stayed alive
+  if (mParticleBudget == 0 || mStats.live + mStats.spawned <= mParticleBudget) {
+    return;
+  }
+
+  // Ties are broken by the spawner so the eviction does not depend on the group order
+  auto priority = [this](std::size_t i) {
+    return mGroupTouched[i] ? mParticles[i].priority : std::numeric_limits<int>::min();
+  };
+  mBudgetOrder.resize(mParticles.size());
+  std::iota(mBudgetOrder.begin(), mBudgetOrder.end(), std::size_t{0});
+  std::sort(mBudgetOrder.begin(), mBudgetOrder.end(), [&](std::size_t a, std::size_t b) {
+    return std::pair{priority(a), mParticles[a].spawner} < std::pair{priority(b), mParticles[b].spawner};
+  });
+
+  auto excess = mStats.live + mStats.spawned - mParticleBudget;
+  for (auto level = mBudgetOrder.begin(); level != mBudgetOrder.end() && excess > 0;) {
+    const auto levelEnd = std::find_if(level, mBudgetOrder.end(), [&](std::size_t i) {
+      return priority(i) != priority(*level);
+    });
+
+    // Bursts of this update are not filled yet, dropping them costs nothing. Batches of removed spawners are stale.
+    for (auto it = level; it != levelEnd && excess > 0; ++it) {
+      auto& group = mParticles[*it];
+      if (!mGroupTouched[*it]) {
+        continue;
+      }
+      auto& batches = group.batches;
+      while (!batches.empty() && excess > 0) {
+        const auto dropped = std::min(batches.back().count, excess);
+        batches.back().count -= dropped;
+        group.streams.head -= dropped;
+        group.spawned -= dropped;
+        excess -= dropped;
+        mStats.throttled += dropped;
+        if (batches.back().count == 0) {
+          batches.pop_back();
+        }
+      }
+      auto& chunks = group.chunks;
+      while (!chunks.empty() && chunks.back().first >= group.streams.head) {
+        chunks.pop_back();
+      }
+      if (!chunks.empty()) {
+        chunks.back().end = std::min(chunks.back().end, group.streams.head);
+      }
+    }
+
+    // All bursts of the level are dropped by now, what is left of the level is resident. Expired particles in front of
+    // an alive one are culled for free.
+    for (auto it = level; it != levelEnd && excess > 0; ++it) {
+      auto& group = mParticles[*it];
+      auto& streams = group.streams;
+      for (; !streams.empty() && excess > 0; streams.tail++) {
+        if (group.expiry.remove(streams.aliveUntil[streams.slot(streams.tail)])) {
+          excess--;
+          mStats.evicted++;
+        }
+      }
+      retireChunks(group);
+    }
+    level = levelEnd;
+  }
+  mStats.spawned -= mStats.throttled;
+  mStats.live -= mStats.evicted;
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "aw/engine/particleSystem/spawner.hpp"
+#include "aw/util/time/time.hpp"
+#include "entt/entity/registry.hpp"
+#include "jobPool.hpp"
+#include "particleSystem/bounds.hpp"
+#include "particleSystem/expiryWheel.hpp"
+#include "particleSystem/lod.hpp"
+#include "particleSystem/pool.hpp"
+#include "particleSystem/spawnSchedule.hpp"
+#include "particleSystem/streams.hpp"
+#include "particleSystem/truncatedNormal.hpp"
+#include "profiler.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Aos is the engine's aw::ParticleSystem, Soa the ParticleSimulation below
+enum class ParticleStorage
+{
+  Aos,
+  Soa,
+};
+
+inline auto particleStorageName(ParticleStorage storage) -> const char*
+{
+  return storage == ParticleStorage::Aos ? "aos" : "soa";
+}
+
+// CPU time spent on one spawner's particles, summed over the updates since ParticleSimulation::setSpawnerCosts
+// enabled the accounting
+struct SpawnerCost
+{
+  std::size_t updates{0};
+  // Preparing the spawner and expiring its particles
+  std::int64_t updateNanoseconds{0};
+  // Scheduling and filling its bursts
+  std::int64_t spawnNanoseconds{0};
+};
+
+// Particles of one spawner entity
+struct SpawnerParticles
+{
+  entt::entity spawner{entt::null};
+  ParticleStreams streams;
+
+  // Render state copied from the spawner component on every update
+  decltype(aw::ParticleSpawner::colorGradient) colorGradient{};
+  float fadeIn{0.f};
+  // Bursts due within an update are spawned along the way from the previous origin
+  aw::Vec3 origin{0.f, 0.f, 0.f};
+
+  SpawnerSampler sampler;
+  SpawnSchedule schedule;
+
+  // Bursts of the current update, recorded by the scheduling jobs. Their ring slots starting at first are reserved in a
+  // serial pass and filled in a parallel one.
+  struct SpawnBatch
+  {
+    std::uint64_t first;
+    std::size_t count;
+    aw::Vec3 origin;
+    float time;
+  };
+  std::vector<SpawnBatch> batches;
+
+  // Runs of consecutive sequence numbers [first, end) and the bounds of their bursts, in spawn order. Chunks are
+  // retired with the ring tail, the first one may start before it.
+  struct Chunk
+  {
+    std::uint64_t first;
+    std::uint64_t end;
+    ParticleBounds bounds;
+  };
+  std::deque<Chunk> chunks;
+  // Union of the chunk bounds
+  ParticleBounds bounds;
+
+  // Alive particles of the ring, the resident ones are an upper bound. Fed once the bursts of an update are filled,
+  // particles leaving the ring before their bucket ended are removed.
+  ExpiryWheel expiry;
+
+  // Detail chosen by the spawner's SpawnerLod in the last update. A sleeping group is neither retired nor spawned into
+  // since sleptFrom, the simulation time it was last updated at.
+  float amountScale{1.f};
+  bool sleeping{false};
+  float sleptFrom{0.f};
+
+  // SpawnerLod::priority of the last update, groups of removed spawners are evicted first
+  int priority{0};
+
+  // Particles spawned and expired (counted out by the wheel) in the last update, throttled bursts are not counted as
+  // spawned
+  std::size_t spawned{0};
+  std::size_t retired{0};
+
+  SpawnerCost cost;
+};
+
+// Quad area of the group's alive particles in world units, estimated from the spawner's size range. particle.vert
+// shrinks a quad to half its size over its lifetime, on average a particle covers 7/12 of its spawn size squared.
+// Expired resident particles are dropped there and cover nothing.
+auto estimatedFillArea(const SpawnerParticles& group) -> float;
+
+// Maintained by ParticleSimulation::update, reading them costs nothing
+struct ParticleStats
+{
+  // Alive particles counted by the groups' expiry wheels. The resident particles uploaded and drawn are an upper bound,
+  // expired particles stay in their ring until everything spawned before them expired.
+  std::size_t live{0};
+  std::size_t peakLive{0};
+  // Spawner groups, those of removed spawners included until their particles expired
+  std::size_t groups{0};
+  // Bytes of the pool spans holding the rings
+  std::size_t bytes{0};
+
+  // Of the last update
+  std::size_t spawned{0};
+  std::size_t retired{0};
+  // Dropped by the particle budget, see ParticleSimulation
+  std::size_t throttled{0};
+  std::size_t evicted{0};
+};
+
+// Simulates every entity with an aw::Transform and aw::ParticleSpawner component.
+// Same motion model as aw::ParticleSystem (positions are evaluated in particle.vert) but with SoA particle storage.
+//
+// Updates run on the job pool: spawners are prepared (spawner state and detail), expired and scheduled (record new
+// bursts) in parallel passes. The ring slots of the bursts are reserved in a serial pass in spawner order, the only
+// one growing rings, then bursts are filled in chunks of spawnChunkSize particles and added to the expiry wheels of
+// their groups. Samples come from a philox generator keyed by the seed and spawner and counted by the particle's
+// sequence number (or the burst number), so a run is reproduced exactly for the same seed regardless of the number of
+// workers. Every sample costs one random word, see TruncatedNormal.
+// A burst is spawned at the time it was due within the update, from the spawner position interpolated to that time,
+// so low update rates do not band the particles into one spawn time per update.
+//
+// With a LodView, spawners with a SpawnerLod component scale their burst amounts by the tier of their camera distance
+// and sleep when far away or out of view. Particles are stateless once spawned, a waking spawner fast-forwards by
+// replaying only the bursts of the last ttl max seconds. GpuParticleSimulation always simulates at full detail.
+//
+// With a particle budget, the live particles of all groups are capped after the spawners were scheduled. Groups are
+// evicted from the lowest priority up: first this update's bursts are throttled, newest first, then the oldest resident
+// particles are culled, expired ones culled along the way do not count. The cap bounds the fill work of every frame,
+// the uploads and draws cover the resident particles and exceed it by the expired ones left in the rings.
+//
+// The rings take their storage from a ParticlePool of poolCapacity particles. Bursts that would grow a ring beyond the
+// pool are dropped and counted in the pool's failed allocations.
+//
+// With spawner costs enabled, every group sums the time its jobs took in SpawnerParticles::cost. Fill jobs time their
+// chunk, the chunks are added to their group after the fill pass. Disabled it costs one branch per job.
+class ParticleSimulation
+{
+public:
+  static constexpr std::size_t spawnChunkSize = 4096;
+  // Bursts are merged into the last bounds chunk of their group until it holds at least this many particles
+  static constexpr std::size_t boundsChunkSize = 1024;
+
+  ParticleSimulation(entt::registry& world, JobPool& jobs, std::uint32_t seed = 0,
+                     std::size_t poolCapacity = ParticlePool::defaultCapacity);
+
+  void update(aw::Seconds dt);
+
+  auto seed() const -> std::uint32_t { return mSeed; }
+  auto simulationTime() const -> float { return mSimulationTime; }
+  auto particles() const -> const std::vector<SpawnerParticles>& { return mParticles; }
+  // nullptr if the spawner has no particles
+  auto particles(entt::entity spawner) const -> const SpawnerParticles*;
+  auto stats() const -> const ParticleStats& { return mStats; }
+  // Its counters cover the last update
+  auto pool() const -> const ParticlePool& { return mPool; }
+
+  // std::nullopt simulates every spawner at full detail
+  void setLodView(const std::optional<LodView>& view) { mLodView = view; }
+
+  // Records the "simulation update", "expiry" and "spawn" stages, nullptr disables profiling. While the profiler
+  // traces, every spawner's expiry and scheduling and every fill job are recorded as well.
+  void setProfiler(Profiler* profiler) { mProfiler = profiler; }
+
+  // Enabling resets the cost of every group
+  auto spawnerCosts() const -> bool { return mSpawnerCosts; }
+  void setSpawnerCosts(bool enabled);
+
+  // Cap on the live particles of all spawners, 0 is unlimited
+  auto particleBudget() const -> std::size_t { return mParticleBudget; }
+  void setParticleBudget(std::size_t budget) { mParticleBudget = budget; }
+
+private:
+  // Components are looked up before the jobs run, the registry is not touched from worker threads
+  struct ActiveSpawner
+  {
+    std::size_t group;
+    aw::ParticleSpawner* spawner;
+    const SpawnerLod* lod;
+    aw::Vec3 origin;
+    // Set by prepare
+    aw::Vec3 previousOrigin{0.f, 0.f, 0.f};
+    bool sleeping{false};
+  };
+
+  struct SpawnChunk
+  {
+    std::size_t active;
+    std::size_t batch;
+    std::uint64_t first;
+    std::size_t count;
+    // Set by fill with spawner costs enabled
+    std::int64_t nanoseconds{0};
+  };
+
+  // A new group starts at the spawner's origin
+  auto group(entt::entity spawner, const aw::Vec3& origin) -> std::size_t;
+
+  void prepare(ActiveSpawner& active, float dt);
+  void expire(const ActiveSpawner& active);
+  void schedule(const ActiveSpawner& active, float dt);
+  // Replays the bursts the group would have spawned while sleeping for the given seconds before time
+  void fastForward(const ActiveSpawner& active, float slept, float time);
+  // Records a burst spawned at time, count is scaled by the group's amountScale
+  void spawnBurst(SpawnerParticles& group, const aw::Vec3& origin, float time, std::size_t count);
+  // Reserves the ring slots of the recorded bursts, in order. Bursts the ring cannot grow for are dropped.
+  void reserveBursts(SpawnerParticles& group);
+  void fill(SpawnChunk& chunk);
+  // Adds the filled bursts to the group's expiry wheel
+  void countBursts(const ActiveSpawner& active);
+  void enforceBudget();
+
+private:
+  entt::registry& mWorld;
+  JobPool& mJobs;
+  std::uint32_t mSeed;
+
+  float mSimulationTime{0.f};
+  std::optional<LodView> mLodView;
+  Profiler* mProfiler{nullptr};
+  // mProfiler while it traces, for the zones of the jobs
+  Profiler* mTrace{nullptr};
+  bool mSpawnerCosts{false};
+
+  std::size_t mParticleBudget{0};
+  std::vector<std::size_t> mBudgetOrder;
+
+  ParticleStats mStats;
+  // Summed up by the expiry jobs and the wheel feeding ones, the live count is updated by them
+  std::atomic<std::size_t> mRetired{0};
+  std::atomic<std::size_t> mCounted{0};
+
+  // Declared before the groups, their rings are released into it
+  ParticlePool mPool;
+  std::vector<SpawnerParticles> mParticles;
+  std::unordered_map<entt::entity, std::size_t> mGroupIndices;
+  std::vector<bool> mGroupTouched;
+
+  std::vector<ActiveSpawner> mActiveSpawners;
+  std::vector<SpawnChunk> mSpawnChunks;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "aw/util/math/vector.hpp"
+#include "particleSystem/philox.hpp"
+#include "particleSystem/truncatedNormal.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Position of a spawner moving linearly from `from` to `to` over a step of dt seconds, late seconds before its end
+inline auto burstOrigin(const aw::Vec3& from, const aw::Vec3& to, float late, float dt) -> aw::Vec3
+{
+  const auto t = dt > 0.f ? 1.f - late / dt : 1.f;
+  return {from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t, from.z + (to.z - from.z) * t};
+}
+
+// Spawn timer of one spawner, shared by the simulation backends so they spawn the same bursts for the same seed.
+// Burst n consumes block 0 of philox::Stream::Schedule index n: word 0 samples the amount, word 1 the interval.
+struct SpawnSchedule
+{
+  // Lower bound for sampled spawn intervals, an interval of 0 would otherwise spawn forever
+  static constexpr float minInterval = 0.001f;
+
+  float timeUntilSpawn{0.f};
+  // Number of bursts sampled so far
+  std::uint64_t bursts{0};
+
+  // Advances the timer by dt and calls spawn(count, late) for every due burst with at least one particle. The burst was
+  // due late seconds before the end of the step, late is in [0, dt].
+  template <typename Spawn>
+  void advance(const SpawnerSampler& sampler, philox::Key key, float dt, Spawn&& spawn)
+  {
+    timeUntilSpawn -= dt;
+    while (timeUntilSpawn <= 0.f) {
+      const auto words = philox::generate(key, philox::counter(philox::Stream::Schedule, bursts++, 0));
+      const auto amount = static_cast<int>(std::round(sampler.amount(words[0])));
+      if (amount > 0) {
+        spawn(static_cast<std::size_t>(amount), -timeUntilSpawn);
+      }
+      timeUntilSpawn += std::max(sampler.interval(words[1]), minInterval);
+    }
+  }
+
+  // Advances the timer by dt without spawning. The skipped bursts are not sampled, their number is estimated from the
+  // mean interval to move the burst counter past them in constant time.
+  void skip(const SpawnerSampler& sampler, float dt)
+  {
+    timeUntilSpawn -= dt;
+    if (timeUntilSpawn > 0.f) {
+      return;
+    }
+    const auto meanInterval = std::max(sampler.interval.mid(), minInterval);
+    const auto missed = std::ceil(-timeUntilSpawn / meanInterval);
+    bursts += static_cast<std::uint64_t>(missed);
+    timeUntilSpawn += missed * meanInterval;
+  }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "aw/util/math/vector.hpp"
+#include "particleSystem/pool.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+// One attribute stream inside the storage of a ParticleStreams
+template <typename T>
+class ParticleStream
+{
+public:
+  auto operator[](std::size_t i) -> T& { return mData[i]; }
+  auto operator[](std::size_t i) const -> const T& { return mData[i]; }
+  auto data() -> T* { return mData; }
+  auto data() const -> const T* { return mData; }
+  auto size() const -> std::size_t { return mSize; }
+
+private:
+  friend struct ParticleStreams;
+
+  T* mData{nullptr};
+  std::size_t mSize{0};
+};
+
+// Particle data stored as one contiguous array per attribute (structure of arrays).
+// Every stream maps 1:1 to a vertex attribute of particle.vert and can be uploaded as its own buffer.
+//
+// The streams form a ring buffer in spawn order. Every particle gets a sequence number when it is spawned and lives
+// in slot (sequence & (capacity - 1)). Since particles of one spawner die roughly in spawn order, expired particles
+// are retired from the tail until the first alive one, no scan over all resident particles is needed. The resident
+// particles are only an upper bound of the alive ones, SpawnerParticles::expiry counts those.
+//
+// The streams of a ring share one span of a ParticlePool, or of the heap without a pool.
+struct ParticleStreams
+{
+  struct SlotRange
+  {
+    std::size_t first{0};
+    std::size_t count{0};
+  };
+
+  ParticleStream<aw::Vec4> positionSize;
+  ParticleStream<aw::Vec2> velocity;
+  ParticleStream<float> rotation;
+  ParticleStream<float> aliveUntil;
+  ParticleStream<float> aliveFor;
+
+  // Sequence number of the oldest resident particle
+  std::uint64_t tail{0};
+  // Sequence number the next spawned particle gets
+  std::uint64_t head{0};
+
+  explicit ParticleStreams(ParticlePool* pool = nullptr) : mPool{pool} {}
+  ~ParticleStreams() { release(); }
+
+  ParticleStreams(const ParticleStreams&) = delete;
+  auto operator=(const ParticleStreams&) -> ParticleStreams& = delete;
+
+  ParticleStreams(ParticleStreams&& other) noexcept { *this = std::move(other); }
+  auto operator=(ParticleStreams&& other) noexcept -> ParticleStreams&
+  {
+    if (this != &other) {
+      release();
+      positionSize = std::exchange(other.positionSize, {});
+      velocity = std::exchange(other.velocity, {});
+      rotation = std::exchange(other.rotation, {});
+      aliveUntil = std::exchange(other.aliveUntil, {});
+      aliveFor = std::exchange(other.aliveFor, {});
+      tail = std::exchange(other.tail, 0);
+      head = std::exchange(other.head, 0);
+      mPool = other.mPool;
+      mStorage = std::exchange(other.mStorage, nullptr);
+    }
+    return *this;
+  }
+
+  auto size() const -> std::size_t { return static_cast<std::size_t>(head - tail); }
+  auto empty() const -> bool { return head == tail; }
+  auto capacity() const -> std::size_t { return aliveUntil.size(); }
+
+  auto slot(std::uint64_t sequence) const -> std::size_t
+  {
+    return static_cast<std::size_t>(sequence) & (capacity() - 1);
+  }
+
+  // Resident particles in spawn order as at most two contiguous slot ranges, the second one is only used on wrap
+  auto ranges() const -> std::array<SlotRange, 2> { return ranges(tail, head); }
+
+  // Slot ranges of the resident sequence numbers [from, to)
+  auto ranges(std::uint64_t from, std::uint64_t to) const -> std::array<SlotRange, 2>
+  {
+    if (from >= to) {
+      return {};
+    }
+    const auto first = slot(from);
+    const auto count = static_cast<std::size_t>(to - from);
+    const auto firstCount = count < capacity() - first ? count : capacity() - first;
+    return {{{first, firstCount}, {0, count - firstCount}}};
+  }
+
+  // Appends count particles and returns the sequence number of the first one, their data is left uninitialized.
+  // std::nullopt if the ring had to grow and the pool is exhausted.
+  auto push(std::size_t count) -> std::optional<std::uint64_t>
+  {
+    if (!reserve(size() + count)) {
+      return std::nullopt;
+    }
+    const auto first = head;
+    head += count;
+    return first;
+  }
+
+  void retire(std::size_t count) { tail += count; }
+
+  void clear() { tail = head; }
+
+  // Returns false if the pool is exhausted, the streams are left unchanged then
+  auto reserve(std::size_t count) -> bool
+  {
+    if (count <= capacity()) {
+      return true;
+    }
+    std::size_t newCapacity = capacity() > 0 ? capacity() : ParticlePool::minSpan;
+    while (newCapacity < count) {
+      newCapacity *= 2;
+    }
+    return relocate(newCapacity);
+  }
+
+private:
+  template <typename T>
+  static void relocate(ParticleStream<T>& stream, unsigned char*& storage, std::size_t newCapacity,
+                       std::uint64_t tail, std::uint64_t head)
+  {
+    ParticleStream<T> relocated;
+    relocated.mData = reinterpret_cast<T*>(storage);
+    relocated.mSize = newCapacity;
+    storage += newCapacity * sizeof(T);
+
+    const auto oldMask = stream.mSize - 1;
+    const auto newMask = newCapacity - 1;
+    for (auto sequence = tail; sequence < head; sequence++) {
+      relocated[static_cast<std::size_t>(sequence) & newMask] = stream[static_cast<std::size_t>(sequence) & oldMask];
+    }
+    stream = relocated;
+  }
+
+  auto relocate(std::size_t newCapacity) -> bool
+  {
+    auto* storage = mPool ? mPool->allocate(newCapacity) : new unsigned char[newCapacity * ParticlePool::particleBytes];
+    if (!storage) {
+      return false;
+    }
+    const auto oldStorage = std::exchange(mStorage, storage);
+    const auto oldCapacity = capacity();
+    relocate(positionSize, storage, newCapacity, tail, head);
+    relocate(velocity, storage, newCapacity, tail, head);
+    relocate(rotation, storage, newCapacity, tail, head);
+    relocate(aliveUntil, storage, newCapacity, tail, head);
+    relocate(aliveFor, storage, newCapacity, tail, head);
+    release(oldStorage, oldCapacity);
+    return true;
+  }
+
+  void release(unsigned char* storage, std::size_t capacity)
+  {
+    if (mPool) {
+      mPool->release(storage, capacity);
+    } else {
+      delete[] storage;
+    }
+  }
+  void release() { release(mStorage, capacity()); }
+
+  ParticlePool* mPool{nullptr};
+  unsigned char* mStorage{nullptr};
+};
@@ -0,0 +1,57 @@
+#include "particleSystem/truncatedNormal.hpp"
+
+#include <cmath>
+
+namespace {
+constexpr double truncation = 3.0;
+
+auto normalCdf(double x) -> double
+{
+  return 0.5 * std::erfc(-x / std::sqrt(2.0));
+}
+
+auto buildQuantiles() -> std::array<float, TruncatedNormal::tableSize + 1>
+{
+  const auto lower = normalCdf(-truncation);
+  const auto upper = normalCdf(truncation);
+
+  std::array<float, TruncatedNormal::tableSize + 1> quantiles{};
+  quantiles.front() = -1.f;
+  quantiles.back() = 1.f;
+  for (std::size_t i = 1; i < TruncatedNormal::tableSize; i++) {
+    const auto p = lower + (upper - lower) * static_cast<double>(i) / static_cast<double>(TruncatedNormal::tableSize);
+    // The CDF is monotonic, bisection converges to double precision within 64 steps
+    auto a = -truncation;
+    auto b = truncation;
+    for (int step = 0; step < 64; step++) {
+      const auto m = (a + b) * 0.5;
+      (normalCdf(m) < p ? a : b) = m;
+    }
+    quantiles[i] = static_cast<float>((a + b) * 0.5 / truncation);
+  }
+  return quantiles;
+}
+
+void refresh(TruncatedNormal& sampler, const aw::ClampedNormalDist<float>& dist)
+{
+  if (sampler.min() != dist.min() || sampler.max() != dist.max()) {
+    sampler = TruncatedNormal{dist};
+  }
+}
+} // namespace
+
+const std::array<float, TruncatedNormal::tableSize + 1> TruncatedNormal::sQuantiles = buildQuantiles();
+
+void SpawnerSampler::update(const aw::ParticleSpawner& spawner)
+{
+  refresh(particle[PositionX], spawner.position[0]);
+  refresh(particle[PositionY], spawner.position[1]);
+  refresh(particle[PositionZ], spawner.position[2]);
+  refresh(particle[Size], spawner.size);
+  refresh(particle[Rotation], spawner.rotation);
+  refresh(particle[VelocityX], spawner.velocityDir[0]);
+  refresh(particle[VelocityY], spawner.velocityDir[1]);
+  refresh(particle[Ttl], spawner.ttl);
+  refresh(amount, spawner.amount);
+  refresh(interval, spawner.interval);
+}
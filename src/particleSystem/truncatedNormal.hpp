@@ -0,0 +1,73 @@
+#pragma once
+
+#include "aw/engine/particleSystem/spawner.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Normal distribution truncated to [min, max] with the mean in the middle of the range and a standard deviation of a
+// sixth of the range, the same shape aw::ClampedNormalDist describes. Every range shares one inverse CDF table of the
+// standard normal truncated to [-3, 3], a sample is a table lookup with linear interpolation driven by a single random
+// word. The cost does not depend on the range, there is no rejection loop.
+class TruncatedNormal
+{
+public:
+  static constexpr int tableBits = 10;
+  static constexpr std::size_t tableSize = std::size_t{1} << tableBits;
+
+  TruncatedNormal() = default;
+  TruncatedNormal(float min, float max) : mMin{min}, mMax{max}, mMid{(min + max) * 0.5f}, mHalfRange{(max - min) * 0.5f}
+  {
+  }
+  TruncatedNormal(const aw::ClampedNormalDist<float>& dist) : TruncatedNormal{dist.min(), dist.max()} {}
+
+  auto min() const -> float { return mMin; }
+  auto max() const -> float { return mMax; }
+  auto mid() const -> float { return mMid; }
+  auto halfRange() const -> float { return mHalfRange; }
+
+  // Shared by every range, uploaded as is by GpuParticleSimulation
+  static auto quantiles() -> const std::array<float, tableSize + 1>& { return sQuantiles; }
+
+  auto operator()(std::uint32_t word) const -> float
+  {
+    const auto index = word >> (32 - tableBits);
+    const auto fraction = static_cast<float>(word & ((1u << (32 - tableBits)) - 1)) * (1.f / (1u << (32 - tableBits)));
+    const auto q = sQuantiles[index] + (sQuantiles[index + 1] - sQuantiles[index]) * fraction;
+    return mMid + mHalfRange * q;
+  }
+
+private:
+  // Inverse CDF at i / tableSize, divided by 3 so it spans [-1, 1]
+  static const std::array<float, tableSize + 1> sQuantiles;
+
+  float mMin{0.f};
+  float mMax{0.f};
+  float mMid{0.f};
+  float mHalfRange{0.f};
+};
+
+// Samplers for the ranges of one spawner, refreshed from the component whenever a range was edited
+struct SpawnerSampler
+{
+  // Per particle properties in the order ParticleSimulation consumes random words
+  enum Property
+  {
+    PositionX,
+    PositionY,
+    PositionZ,
+    Size,
+    Rotation,
+    VelocityX,
+    VelocityY,
+    Ttl,
+    ParticlePropertyCount,
+  };
+
+  std::array<TruncatedNormal, ParticlePropertyCount> particle;
+  TruncatedNormal amount;
+  TruncatedNormal interval;
+
+  void update(const aw::ParticleSpawner& spawner);
+};
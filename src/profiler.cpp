@@ -0,0 +1,122 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+Profiler::Profiler() : mStart{Clock::now()}, mMainThread{threadIndex()} {}
+
+auto Profiler::now() const -> std::int64_t
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mStart).count();
+}
+
+void Profiler::add(const Event& event)
+{
+  auto& buffer = mThreadEvents[event.thread % maxThreads];
+  std::lock_guard lock{buffer.mutex};
+  buffer.events.push_back(event);
+}
+
+void Profiler::record(const char* name, float seconds)
+{
+  std::lock_guard lock{mRecordMutex};
+  mRecords.emplace_back(name, seconds);
+}
+
+void Profiler::endFrame()
+{
+  mLastFrameEvents.clear();
+  for (auto& buffer : mThreadEvents) {
+    std::lock_guard lock{buffer.mutex};
+    mLastFrameEvents.insert(mLastFrameEvents.end(), buffer.events.begin(), buffer.events.end());
+    buffer.events.clear();
+  }
+
+  const auto slot = mFrame % historySize;
+  for (auto& stage : mStages) {
+    stage.seconds[slot] = 0.f;
+  }
+  for (const auto& event : mLastFrameEvents) {
+    stage(event.name).seconds[slot] += static_cast<float>(event.end - event.begin) * 1e-9f;
+  }
+  {
+    std::lock_guard lock{mRecordMutex};
+    for (const auto& [name, seconds] : mRecords) {
+      stage(name).seconds[slot] += seconds;
+    }
+    mRecords.clear();
+  }
+
+  // The frame itself is only a zone of the trace, not a stage
+  const auto frameEnd = now();
+  if (tracing()) {
+    if (mTrace.size() < mTraceFrames) {
+      mTrace.emplace_back();
+    }
+    auto& traced = mTrace[mTraceNext];
+    traced.assign(mLastFrameEvents.begin(), mLastFrameEvents.end());
+    traced.push_back({"frame", threadIndex(), mFrameBegin, frameEnd});
+    mTraceNext = (mTraceNext + 1) % mTraceFrames;
+  }
+  mFrameBegin = frameEnd;
+  mFrame++;
+}
+
+void Profiler::setTraceFrames(std::size_t frames)
+{
+  mTraceFrames = frames;
+  mTrace.clear();
+  mTraceNext = 0;
+}
+
+auto Profiler::writeChromeTrace(const aw::fs::path& path) const -> bool
+{
+  std::ofstream file(path);
+  file << std::fixed << std::setprecision(3) << "[\n";
+  std::uint32_t threads = 0;
+  const auto oldest = mTrace.size() < mTraceFrames ? 0 : mTraceNext;
+  for (std::size_t i = 0; i < mTrace.size(); i++) {
+    for (const auto& event : mTrace[(oldest + i) % mTrace.size()]) {
+      // Chrome traces count in microseconds
+      file << R"({"name":")" << event.name << R"(","ph":"X","pid":0,"tid":)" << event.thread
+           << R"(,"ts":)" << static_cast<double>(event.begin) * 1e-3
+           << R"(,"dur":)" << static_cast<double>(event.end - event.begin) * 1e-3;
+      if (event.spawner != noSpawner) {
+        file << R"(,"args":{"spawner":)" << event.spawner << "}";
+      }
+      file << "},\n";
+      threads = std::max(threads, event.thread + 1);
+    }
+  }
+  for (std::uint32_t thread = 0; thread < threads; thread++) {
+    file << R"({"name":"thread_name","ph":"M","pid":0,"tid":)" << thread << R"(,"args":{"name":")";
+    if (thread == mMainThread) {
+      file << "main";
+    } else {
+      file << "thread " << thread;
+    }
+    file << "\"}}" << (thread + 1 < threads ? ",\n" : "\n");
+  }
+  file << "]\n";
+  return static_cast<bool>(file);
+}
+
+auto Profiler::threadIndex() -> std::uint32_t
+{
+  static std::atomic<std::uint32_t> threads{0};
+  thread_local const auto index = threads++;
+  return index;
+}
+
+auto Profiler::stage(const char* name) -> Stage&
+{
+  for (auto& stage : mStages) {
+    if (stage.name == name || std::strcmp(stage.name, name) == 0) {
+      return stage;
+    }
+  }
+  return mStages.emplace_back(Stage{name, {}});
+}
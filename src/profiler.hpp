@@ -0,0 +1,129 @@
+#pragma once
+
+#include "aw/util/filesystem/fileStream.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Time spent in named stages per frame. CPU stages are recorded with ProfileScope from any thread, times measured
+// elsewhere (GPU queries) are added with record. endFrame sums the frame's events per stage name into a history of
+// historySize frames. Stage names have to be string literals or otherwise outlive the profiler.
+//
+// While tracing, the events of the last traceFrames frames are kept and can be written as a Chrome trace (JSON array
+// of complete events, readable by chrome://tracing and Perfetto). Instrumented code adds finer zones, per spawner and
+// worker job, only while tracing. Without a profiler a scope costs one branch.
+class Profiler
+{
+public:
+  static constexpr std::size_t historySize = 240;
+  static constexpr std::uint32_t noSpawner = ~std::uint32_t{0};
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Event
+  {
+    const char* name;
+    // Index of the recording thread, in the order threads first recorded an event
+    std::uint32_t thread;
+    // Nanoseconds since the profiler was created
+    std::int64_t begin;
+    std::int64_t end;
+    // Spawner entity the zone worked on, noSpawner if none
+    std::uint32_t spawner{noSpawner};
+  };
+
+  struct Stage
+  {
+    const char* name;
+    // Seconds per frame, frame() % historySize is the slot of the next frame
+    std::array<float, historySize> seconds{};
+  };
+
+  Profiler();
+
+  Profiler(const Profiler&) = delete;
+  auto operator=(const Profiler&) -> Profiler& = delete;
+
+  auto now() const -> std::int64_t;
+  // Thread safe
+  void add(const Event& event);
+  void record(const char* name, float seconds);
+
+  // Closes the current frame, its events stay readable as lastFrameEvents until the next endFrame
+  void endFrame();
+
+  // Frames ended so far
+  auto frame() const -> std::size_t { return mFrame; }
+  // In the order the names were first seen
+  auto stages() const -> const std::vector<Stage>& { return mStages; }
+  auto lastFrameEvents() const -> const std::vector<Event>& { return mLastFrameEvents; }
+
+  // Keeps the events of the last frames frames, 0 stops tracing and drops them. Not while a frame is recorded.
+  void setTraceFrames(std::size_t frames);
+  auto traceFrames() const -> std::size_t { return mTraceFrames; }
+  auto tracing() const -> bool { return mTraceFrames > 0; }
+  // Frames currently kept, at most traceFrames
+  auto tracedFrames() const -> std::size_t { return mTrace.size(); }
+  auto writeChromeTrace(const aw::fs::path& path) const -> bool;
+
+  static auto threadIndex() -> std::uint32_t;
+
+private:
+  static constexpr std::size_t maxThreads = 64;
+
+  // Every thread adds to its own buffer, the lock is only contended by endFrame
+  struct alignas(64) ThreadEvents
+  {
+    std::mutex mutex;
+    std::vector<Event> events;
+  };
+
+  auto stage(const char* name) -> Stage&;
+
+  Clock::time_point mStart;
+  std::uint32_t mMainThread;
+
+  std::array<ThreadEvents, maxThreads> mThreadEvents;
+  std::mutex mRecordMutex;
+  std::vector<std::pair<const char*, float>> mRecords;
+
+  std::vector<Event> mLastFrameEvents;
+  std::vector<Stage> mStages;
+  std::size_t mFrame{0};
+  std::int64_t mFrameBegin{0};
+
+  std::size_t mTraceFrames{0};
+  // Ring of frames, mTraceNext is the oldest once it is full
+  std::vector<std::vector<Event>> mTrace;
+  std::size_t mTraceNext{0};
+};
+
+// Records the lifetime of the scope as an event of the stage name, does nothing without a profiler
+class ProfileScope
+{
+public:
+  ProfileScope(Profiler* profiler, const char* name, std::uint32_t spawner = Profiler::noSpawner) :
+      mProfiler{profiler}, mName{name}, mSpawner{spawner}, mBegin{profiler ? profiler->now() : 0}
+  {
+  }
+  ~ProfileScope()
+  {
+    if (mProfiler) {
+      mProfiler->add({mName, Profiler::threadIndex(), mBegin, mProfiler->now(), mSpawner});
+    }
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  auto operator=(const ProfileScope&) -> ProfileScope& = delete;
+
+private:
+  Profiler* mProfiler;
+  const char* mName;
+  std::uint32_t mSpawner;
+  std::int64_t mBegin;
+};